@@ -0,0 +1,76 @@
+// ----------------------------------------------------------------------------
+// ai.hpp
+//
+// Placement AI driven by the top surface of the stack, with a precomputed
+// table of the best placement for every bounded surface.
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include "core.hpp"
+
+namespace ai {
+
+    // column heights of a stack
+    typedef std::array<uint8_t, WIDTH> heights_t;
+
+    // A placement: rotate `rot` times from the spawn state, shift the piece
+    // until its leftmost cell is in column `col`, then drop it
+    struct Move {
+        uint8_t rot;
+        uint8_t col;
+    };
+
+    // largest height difference between neighbouring columns in the table
+    inline constexpr uint8_t kMaxStep = 2;
+    // surfaces in the table, `(2 * kMaxStep + 1) ^ (WIDTH - 1)`
+    inline constexpr uint32_t kNSurface = 1953125;
+
+    // fill `h` from the landed blocks
+    void heights(const field_t &, heights_t &h);
+
+    // index of the surface of `h` in the table, `kNSurface` if two
+    // neighbouring columns differ by more than `kMaxStep`
+    uint32_t surface(const heights_t &);
+
+    // Best placement of piece `type` on a stack with column heights `h`,
+    // judged by the surface it leaves (holes, bumpiness and height); return
+    // its cost, lower is better. Only the differences between heights
+    // matter.
+    uint16_t search(uint8_t type, const heights_t &h, Move &);
+
+    // Precomputed `search` of every surface of the table and piece type,
+    // mapped from a file written by `generate`
+    struct Table {
+        const uint8_t *data = nullptr; // mapped file, nullptr if none
+        size_t size = 0;
+
+        ~Table();
+
+        // map the table at `path`, return false if it is no table
+        bool Open(const char *path);
+
+        // placement of `type` on `h`, return false if the surface is not in
+        // the table
+        bool Get(uint8_t type, const heights_t &h, Move &) const;
+    };
+
+    // Placement for the current piece: from the table if it has the surface
+    // and the stack is low enough for every placement to be reachable,
+    // searched otherwise; return true if it came from the table.
+    bool choose(const Table &, const core::Piece &, const core::Board &,
+                Move &);
+
+    // Rotate, shift and drop the piece as `m` says, with the game's own
+    // moves; return false if it got blocked on the way (it is then dropped
+    // where it got).
+    bool apply(const Move &m, core::Piece &, const core::Board &);
+
+    // write the table to `path`
+    int generate(const char *path);
+
+    // play `games` headless games from `seed` with the table at `path` ("-"
+    // for none) and report how it did
+    int autoplay(const char *path, uint32_t games, uint64_t seed);
+
+} // namespace ai
@@ -0,0 +1,17 @@
+// ----------------------------------------------------------------------------
+// bench.hpp
+//
+// End-to-end benchmark of the game pipeline over a fixed corpus of headless
+// games, with hardware performance counters per stage.
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+namespace bench {
+
+    // Play the corpus and report the cost of each stage per call, per frame
+    // and per placement; compare against the baseline at `path` if there is
+    // one, or save the results there (always if `save`).
+    int run(const char *path, bool save);
+
+} // namespace bench
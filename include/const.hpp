@@ -20,6 +20,8 @@
 typedef std::array<uint8_t, NBRK> brick_t;
 // Dense representation of the whole board (IMP: enum class Pixel)
 typedef std::array<uint8_t, TOTAL> field_t;
+// Compact binary snapshot of a game (layout in core_snapshot.cpp)
+typedef std::array<uint8_t, 48> snapshot_t;
 
 typedef std::chrono::seconds sec;
 typedef std::chrono::steady_clock steady_clock;
@@ -4,6 +4,12 @@
 
 namespace core {
 
+    // Number of piece types (`kArrDef` in core_piece.cpp)
+    inline constexpr uint8_t kNType = 7;
+    // Number of rotation states per piece; `Piece::state` is
+    // `type * kNRot + rotation`
+    inline constexpr uint8_t kNRot = 4;
+
     // Tetris board
     //
     // - The Tetris board is a 10x20 (width x height) grid of cells; its origin
@@ -19,6 +25,7 @@ namespace core {
     // - add indices of lines exploded for animation from the client
     struct Board {
         time_point last_fall; // last fall timestamp
+        uint64_t rng;         // state of the piece generator
         field_t base;         // base board
         field_t active;       // active board (base + active piece)
         uint16_t lines;       // lines cleared
@@ -28,6 +35,9 @@ namespace core {
         // constructor
         Board();
 
+        // constructor with a fixed generator seed (reproducible games)
+        explicit Board(const uint64_t &);
+
         uint8_t Pop();
 
         void UpdateActive(const brick_t &);
@@ -37,20 +47,22 @@ namespace core {
 
     // holds the current piece type and position
     struct Piece {
-        uint8_t state;  // piece current shape
-        brick_t cur;    // current position
-        brick_t left;   // left position
-        brick_t right;  // right position
-        brick_t down;   // down position
-        brick_t rotate; // rotated position
-        brick_t round;  // surrounding position (detect rotation collision)
+        uint8_t state; // piece type and rotation
+        brick_t cur;   // current position, pivot first
+        brick_t left;  // left position
+        brick_t right; // right position
+        brick_t down;  // down position
 
         char Shape(const uint8_t &);
 
         // initialize piece context according to index
         void Spawn(const uint8_t &);
 
-        void Rotate();
+        // restore piece context from a state and position
+        bool Restore(const uint8_t &, const brick_t &);
+
+        // rotate clockwise with SRS wall kicks, return false if blocked
+        bool Rotate(const field_t &);
 
         void Left();
 
@@ -61,7 +73,15 @@ namespace core {
 
     bool collide(const brick_t &, const field_t &);
 
-    bool step(core::Piece &, core::Board &);
+    steady_clock::duration gravity(const uint16_t &);
+
+    bool land(core::Piece &, core::Board &);
+
+    bool input(const char &, core::Piece &, const core::Board &);
 
     void ToString(const field_t &, std::array<std::string, HEIGHT> &);
+
+    void save(const core::Piece &, const core::Board &, snapshot_t &);
+
+    bool load(const snapshot_t &, core::Piece &, core::Board &);
 } // namespace core
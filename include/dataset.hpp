@@ -0,0 +1,115 @@
+// ----------------------------------------------------------------------------
+// dataset.hpp
+//
+// Compact columnar encoding of board states for training and analysis, with
+// random access by game and ply.
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "core.hpp"
+
+namespace dataset {
+
+    // One recorded state (ply) of a game
+    //
+    // `heights` is derived from `base`; it is stored as its own column so that
+    // analyses of the surface do not have to decode the board.
+    struct State {
+        field_t base;                        // landed blocks
+        brick_t cur;                         // current piece, pivot first
+        std::array<uint8_t, WIDTH> heights;  // column heights of `base`
+        uint16_t lines;                      // lines cleared
+        uint8_t piece;                       // `Piece::state`
+        uint8_t next;                        // `Board::next`
+    };
+
+    // Columns, decoded selectively (`kCol*` bits)
+    inline constexpr uint8_t kColRows = 1 << 0;    // `base`
+    inline constexpr uint8_t kColHeights = 1 << 1; // `heights`
+    inline constexpr uint8_t kColPiece = 1 << 2;   // `piece` and `cur`
+    inline constexpr uint8_t kColNext = 1 << 3;    // `next`
+    inline constexpr uint8_t kColLines = 1 << 4;   // `lines`
+    inline constexpr uint8_t kColAll = 0x1F;
+
+    // states per chunk, the unit of random access
+    inline constexpr uint16_t kChunk = 256;
+
+    // fill `s` from a game
+    void capture(const core::Piece &, const core::Board &, State &);
+
+    // restore a game from `s`, return false if the piece is invalid or
+    // overlaps the landed blocks
+    bool restore(const State &, core::Piece &, core::Board &);
+
+    // Append one chunk of `n` (at most `kChunk`) consecutive states of a game
+    // to `out`.
+    void encode(const State *, uint16_t n, std::string &out);
+
+    // Decode the chunk at the front of `buf` into `out`, only filling the
+    // requested columns; return the number of bytes consumed, 0 if invalid.
+    size_t decode(std::string_view buf, std::vector<State> &out,
+                  uint8_t columns = kColAll);
+
+    // index entry: the chunk at `offset` starts with ply `ply` of `game`
+    struct Entry {
+        uint32_t game;
+        uint32_t ply;
+        uint64_t offset;
+    };
+
+    // Dataset being written, kept in memory
+    //
+    // File layout: chunks, then the index (one `Entry` per chunk, sorted by
+    // game and ply), then a 20-byte footer with the index offset, the number
+    // of entries and games, and a magic.
+    struct Writer {
+        std::string out;            // encoded chunks so far
+        std::vector<Entry> index;   // one entry per chunk
+        std::vector<State> pending; // states of the chunk being filled
+        uint32_t game = 0;          // current game
+        uint32_t ply = 0;           // plies of the current game
+
+        // append a state to the current game
+        void Add(const State &);
+
+        // end the current game
+        void Next();
+
+        // end the dataset, `out` then holds the whole file
+        void Finish();
+    };
+
+    // Dataset being read, backed by the caller's buffer
+    struct Reader {
+        std::string_view data;
+        std::vector<Entry> index;
+        std::vector<State> chunk; // last decoded chunk
+        size_t cached = SIZE_MAX; // its index entry
+        uint8_t columns = 0;      // its decoded columns
+
+        // parse the footer and index, return false if `data` is no dataset
+        bool Open(std::string_view);
+
+        // number of games
+        uint32_t Games() const;
+
+        // number of plies of a game
+        uint32_t Plies(uint32_t) const;
+
+        // decode ply `ply` of game `game`, return false if there is none
+        bool Get(uint32_t game, uint32_t ply, State &,
+                 uint8_t columns = kColAll);
+    };
+
+    // play `games` headless games from `seed` and save their placements
+    int record(const char *path, uint32_t games, uint64_t seed);
+
+    // print ply `ply` of game `game` of a dataset
+    int replay(const char *path, uint32_t game, uint32_t ply);
+
+} // namespace dataset
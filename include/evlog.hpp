@@ -0,0 +1,84 @@
+// ----------------------------------------------------------------------------
+// evlog.hpp
+//
+// Binary log of game events (spawns, moves, rotations, landings, line
+// clears), written to disk by a background thread.
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+
+#include "core.hpp"
+#include "spsc.hpp"
+
+namespace evlog {
+
+    enum class Kind : uint8_t {
+        Spawn = 0, // new piece
+        Move,      // piece shifted or soft dropped, `arg` is the key
+        Rotate,    // piece rotated
+        Land,      // piece locked into the board
+        Clear,     // lines cleared by the landing, `arg` is how many
+        Over,      // the new piece does not fit, game over
+    };
+    inline constexpr uint8_t kNKind = 6;
+
+    // One event, as stored in the log
+    //
+    // The piece fields hold the piece after the event (the landed piece for
+    // `Land` and `Clear`).
+    struct Record {
+        uint64_t t;       // `steady_clock` time, in nanoseconds
+        uint32_t session; // game the event belongs to
+        Kind kind;
+        uint8_t piece;    // `Piece::state`
+        uint8_t cell;     // `Piece::cur[0]`, the pivot
+        uint8_t arg;      // see `Kind`
+    };
+    static_assert(sizeof(Record) == 16, "records are 16 bytes on disk");
+
+    // events buffered per session (power of 2)
+    inline constexpr size_t kStreamSize = 1024;
+
+    // Events of one session, on their way to the writer
+    //
+    // `Emit` is called by the thread running the game only; it never
+    // blocks: an event that does not fit in the ring is counted and dropped.
+    struct Stream {
+        spsc::Ring<Record, kStreamSize> ring;
+        uint32_t session;
+        alignas(spsc::kCacheLine) std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> closed{false}; // detached, freed by the writer
+
+        void Emit(Kind k, const time_point &t, const core::Piece &p,
+                  uint8_t arg = 0) {
+            const Record r{
+                static_cast<uint64_t>(std::chrono::nanoseconds(
+                                          t.time_since_epoch())
+                                          .count()),
+                session, k, p.state, p.cur[0], arg};
+            if (!ring.Push(r))
+                dropped.store(dropped.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+        }
+    };
+
+    // Start logging to `path`, rotating it once it grows past its size
+    // limit; return false if it cannot be opened.
+    bool open(const char *path);
+
+    // new stream for `session`, nullptr if logging is off
+    Stream *attach(uint32_t session);
+
+    // hand a stream back once its session ended; it must not be used again
+    void detach(Stream *);
+
+    // write out what is left and stop the writer; every stream must have
+    // been detached
+    void close();
+
+    // print the events of a log file
+    int dump(const char *path);
+
+} // namespace evlog
@@ -0,0 +1,90 @@
+// ----------------------------------------------------------------------------
+// metrics.hpp
+//
+// Live process metrics, counted per thread and served in the Prometheus text
+// format.
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+
+#include "const.hpp"
+#include "spsc.hpp"
+
+namespace metrics {
+
+    enum class Counter : uint8_t {
+        Ticks = 0, // game deadlines fired (gravity, lock, shift, release)
+        Frames,    // frames rendered
+        Bytes,     // bytes of rendered frames
+        Lines,     // lines cleared
+        Started,   // games started or resumed
+        Over,      // games lost
+    };
+    inline constexpr uint8_t kNCounter = 6;
+
+    enum class Gauge : uint8_t {
+        Sessions = 0, // games being played
+    };
+    inline constexpr uint8_t kNGauge = 1;
+
+    enum class Histogram : uint8_t {
+        FrameTime = 0, // time to build a frame, in nanoseconds
+        InputDepth,    // keys waiting when the game took them
+    };
+    inline constexpr uint8_t kNHistogram = 2;
+
+    // bucket `i` counts values up to `base << i`, the last one the rest
+    inline constexpr uint8_t kNBucket = 16;
+
+    // Counts of one thread
+    //
+    // Only the owning thread writes its slot, with plain (relaxed) loads and
+    // stores, so counting never contends; a scrape sums the slots of every
+    // thread that ever counted something.
+    struct alignas(spsc::kCacheLine) Slot {
+        std::array<std::atomic<uint64_t>, kNCounter> counters{};
+        std::array<std::atomic<int64_t>, kNGauge> gauges{};
+        struct Buckets {
+            std::array<std::atomic<uint64_t>, kNBucket> n{};
+            std::atomic<uint64_t> sum{0};
+        };
+        std::array<Buckets, kNHistogram> histograms{};
+    };
+
+    // new slot, counted in from now on
+    Slot *attach();
+
+    // slot of the calling thread, registered on first use (not `static`: one
+    // slot per thread, not per translation unit)
+    inline Slot &local() {
+        thread_local Slot *slot = attach();
+        return *slot;
+    }
+
+    static inline void bump(std::atomic<uint64_t> &a, uint64_t n) {
+        a.store(a.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    static inline void add(Counter c, uint64_t n = 1) {
+        bump(local().counters[static_cast<uint8_t>(c)], n);
+    }
+
+    static inline void add(Gauge g, int64_t n) {
+        auto &a = local().gauges[static_cast<uint8_t>(g)];
+        a.store(a.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    // count one value into a histogram
+    void observe(Histogram, uint64_t);
+
+    // Serve the metrics on `where`, a TCP port on the loopback interface if
+    // it is a number, a Unix socket path otherwise; each connection gets one
+    // HTTP response with the current values. Runs on its own thread; return
+    // false if the socket cannot be set up.
+    bool serve(const char *where);
+
+} // namespace metrics
@@ -0,0 +1,126 @@
+// ----------------------------------------------------------------------------
+// net.hpp
+//
+// Multi-session game server and thin terminal client over Unix-domain
+// sockets.
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <string_view>
+
+#include "const.hpp"
+
+namespace net {
+
+    // Wire protocol
+    //
+    // - client -> server: a player opens with `kHelloPlay`, then sends raw
+    //   key bytes, the same ones the local game reads from stdin (`h`, `j`,
+    //   `k`, `l`, `p`, `q`); a spectator instead opens with `kHelloWatch`
+    //   followed by the little-endian 32-bit id of the session to watch. The
+    //   server sets nothing up for a connection before its first byte, and
+    //   takes any first byte but `kHelloWatch` for a player.
+    // - server -> client: frames, each a 5-byte header followed by `n` cell
+    //   indices whose pixel flipped since the previous frame
+    //
+    //   [lines lo][lines hi][next][flags][n][idx 0]...[idx n-1]
+    //
+    // Cells are either empty or filled, so a flipped index is all the client
+    // needs to patch its copy of `Board::active`. A keyframe (`kFlagKey`) is
+    // a delta against the empty board: the client clears its copy first.
+    inline constexpr uint8_t kHdrSize = 5;
+    inline constexpr uint8_t kMaxFrame = kHdrSize + TOTAL;
+    inline constexpr uint8_t kFlagOver = 1 << 0; // game over
+    inline constexpr uint8_t kFlagKey = 1 << 1;  // keyframe
+
+    // never produced by a terminal (not valid UTF-8)
+    inline constexpr char kHelloPlay = '\xFE';
+    inline constexpr char kHelloWatch = '\xFF';
+    inline constexpr uint8_t kHelloSize = 5; // watch hello
+
+    // Write the watch hello of session `id` to `out` (`kHelloSize` bytes)
+    static inline void encode_hello(uint32_t id, char *out) {
+        out[0] = kHelloWatch;
+        for (uint8_t i = 0; i < 4; ++i) {
+            out[1 + i] = static_cast<char>(id >> (8 * i));
+        }
+    }
+
+    // session id of a complete watch hello
+    static inline uint32_t decode_hello(const char *in) {
+        const auto *u = reinterpret_cast<const uint8_t *>(in);
+        return static_cast<uint32_t>(u[1] | u[2] << 8 | u[3] << 16) |
+               static_cast<uint32_t>(u[4]) << 24;
+    }
+
+    // frame header
+    struct Frame {
+        uint16_t lines; // lines cleared
+        char next;      // shape of the next piece
+        uint8_t flags;  // `kFlag*` bits
+
+        bool operator==(const Frame &) const = default;
+    };
+
+    // Write one frame to `out` (at least `kMaxFrame` bytes): the header, then
+    // the indices of cells that differ between `prev` and `cur`; return the
+    // frame length.
+    static inline uint8_t encode(const Frame &f, const field_t &prev,
+                                 const field_t &cur, char *out) {
+        uint8_t len = kHdrSize;
+        for (uint8_t i = 0; i < TOTAL; ++i) {
+            if (prev[i] != cur[i]) {
+                out[len++] = static_cast<char>(i);
+            }
+        }
+        out[0] = static_cast<char>(f.lines & 0xFF);
+        out[1] = static_cast<char>(f.lines >> 8);
+        out[2] = f.next;
+        out[3] = static_cast<char>(f.flags);
+        out[4] = static_cast<char>(len - kHdrSize);
+        return len;
+    }
+
+    // Write a keyframe of `cur` to `out`, see `encode`.
+    static inline uint8_t encode_key(Frame f, const field_t &cur, char *out) {
+        static constexpr field_t kEmpty{};
+        f.flags |= kFlagKey;
+        return encode(f, kEmpty, cur, out);
+    }
+
+    // Parse one frame from the front of `buf`, flipping the listed cells of
+    // `field`; return the number of bytes consumed, 0 if incomplete.
+    static inline size_t decode(std::string_view buf, Frame &f,
+                                field_t &field) {
+        if (buf.size() < kHdrSize)
+            return 0;
+        const auto *u = reinterpret_cast<const uint8_t *>(buf.data());
+        const size_t len = kHdrSize + u[4];
+        if (buf.size() < len)
+            return 0;
+        f.lines = static_cast<uint16_t>(u[0] | (u[1] << 8));
+        f.next = static_cast<char>(u[2]);
+        f.flags = u[3];
+        if (f.flags & kFlagKey) {
+            field.fill(0);
+        }
+        for (size_t i = kHdrSize; i < len; ++i) {
+            if (u[i] < TOTAL) {
+                field[u[i]] ^= 1;
+            }
+        }
+        return len;
+    }
+
+    // run the server on socket `path` until SIGINT or SIGTERM, then end
+    // every game and remove the socket
+    int serve(const char *path);
+
+    // connect to the server on socket `path` and play in the terminal
+    int play(const char *path);
+
+    // connect to the server on socket `path` and watch session `id`
+    int watch(const char *path, uint32_t id);
+
+} // namespace net
@@ -0,0 +1,69 @@
+// ----------------------------------------------------------------------------
+// spsc.hpp
+//
+// Wait-free single-producer / single-consumer ring buffer.
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace spsc {
+
+    // one cache line, to keep the two ends of a ring from false sharing
+    inline constexpr size_t kCacheLine = 64;
+
+    // Bounded ring of `N` (power of 2) elements
+    //
+    // `Push` may only be called from one thread and `Pop` from one other
+    // thread; neither ever loops or blocks. Each side keeps a private copy of
+    // the other side's index and only reloads the shared one when the copy
+    // says the ring is full (producer) or empty (consumer).
+    template <typename T, size_t N> struct Ring {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+        // consumer side
+        alignas(kCacheLine) std::atomic<size_t> head{0}; // next to pop
+        size_t tail_seen = 0;
+        // producer side
+        alignas(kCacheLine) std::atomic<size_t> tail{0}; // next to push
+        size_t head_seen = 0;
+
+        alignas(kCacheLine) std::array<T, N> buf;
+
+        // append `v`, return false if the ring is full
+        bool Push(const T &v) {
+            const size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head_seen == N) {
+                head_seen = head.load(std::memory_order_acquire);
+                if (t - head_seen == N)
+                    return false;
+            }
+            buf[t & (N - 1)] = v;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // take the oldest element into `v`, return false if the ring is empty
+        bool Pop(T &v) {
+            const size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail_seen) {
+                tail_seen = tail.load(std::memory_order_acquire);
+                if (h == tail_seen)
+                    return false;
+            }
+            v = buf[h & (N - 1)];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // number of queued elements (approximate while both sides run)
+        size_t Size() const {
+            return tail.load(std::memory_order_acquire) -
+                   head.load(std::memory_order_acquire);
+        }
+    };
+
+} // namespace spsc
@@ -2,10 +2,16 @@
 
 #include "config.h"
 #include "const.hpp"
+#include "spsc.hpp"
+#include <cerrno>
+#include <cstdio>
 #include <fcntl.h>
-#include <iomanip>
 #include <iostream>
+#include <poll.h>
+#include <string>
+#include <sys/eventfd.h>
 #include <termios.h>
+#include <thread>
 #include <unistd.h>
 
 namespace term {
@@ -18,58 +24,217 @@ namespace term {
         raw.c_lflag &= ~(ECHO | ICANON);
         tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
 
-        // Make stdin non-blocking
-        int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
-        fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
+        // Make stdin and stdout non-blocking
+        for (int fd : {STDIN_FILENO, STDOUT_FILENO}) {
+            int flags = fcntl(fd, F_GETFL, 0);
+            fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        }
     }
 
     static inline void disableRawMode(const Termios &orig_termios) {
         tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
+
+        // do not leave the shell with a non-blocking terminal
+        for (int fd : {STDIN_FILENO, STDOUT_FILENO}) {
+            int flags = fcntl(fd, F_GETFL, 0);
+            fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+        }
     }
 
     // Clear the page and move cursor to home position
-    static inline void clearScreen() { std::cout << "\033[2J\033[1;1H"; }
+    static inline void clearScreen(std::string &out) {
+        out += "\033[2J\033[1;1H";
+    }
 
     static inline void
     printScreen(const std::array<std::string, HEIGHT> &screen, const char shape,
-                const uint16_t &s, const bool &game_over) {
+                const uint16_t &s, const bool &game_over, std::string &out) {
+        char side[32];
         // add top border
-        std::cout << std::string(42, '#') << std::endl;
+        out.append(42, '#').append("\n");
         for (uint8_t i = 0; i < screen.size(); ++i) {
             // add left separator
-            std::cout << "##";
+            out += "##";
             // print line
-            std::cout << screen[i];
+            out += screen[i];
             // add right separator
-            std::cout << "##";
+            out += "##";
             if (i == 2) {
-                std::cout << " VERSION: " << VERSION_MAJOR << "."
-                          << VERSION_MINOR << "." << VERSION_PATCH << " "
-                          << "##";
+                std::snprintf(side, sizeof(side), " VERSION: %d.%d.%d ##",
+                              VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
+                out += side;
             } else if (i == 4) {
-                std::cout << "  SCORE: " << std::setw(5) << s << "  "
-                          << "##";
+                std::snprintf(side, sizeof(side), "  SCORE: %5d  ##", s);
+                out += side;
             } else if (i == 6) {
-                std::cout << "   NEXT: " << std::setw(4) << shape << "   "
-                          << "##";
+                std::snprintf(side, sizeof(side), "   NEXT: %4c   ##", shape);
+                out += side;
             } else if (i == 10 && game_over) {
-                std::cout << "    GAME OVER   "
-                          << "##";
+                out += "    GAME OVER   ##";
             } else {
-                std::cout << std::string(16, ' ') << "##";
+                out.append(16, ' ').append("##");
             }
-            std::cout << std::endl;
+            out += "\n";
         }
         // add bottom border
-        std::cout << std::string(42, '#') << std::endl;
+        out.append(42, '#').append("\n");
     }
 
-    static inline void pause(char key) {
-        while (true) {
-            if (read(STDIN_FILENO, &key, 1) > 0 && key == 'p')
-                break;
-            usleep(1000000); // 1 second delay to avoid busy waiting
+    // Non-blocking, frame-dropping terminal output
+    //
+    // At most one frame is being written and one more is waiting for it. A
+    // frame presented while another one is waiting replaces it, so a slow
+    // terminal costs skipped frames instead of a blocked game loop, and the
+    // screen always ends up on the latest frame.
+    struct Output {
+        int fd = STDOUT_FILENO;
+        std::string cur;      // frame being written
+        size_t off = 0;       // bytes of `cur` already written
+        std::string next;     // latest frame, waiting for `cur`
+        uint64_t frames = 0;  // frames presented
+        uint64_t dropped = 0; // frames replaced before being written
+
+        // true while some output has not reached the terminal yet
+        bool Pending() const { return off < cur.size() || !next.empty(); }
+
+        // queue a frame; `frame` is swapped with a spare buffer to reuse
+        void Present(std::string &frame) {
+            ++frames;
+            if (!next.empty())
+                ++dropped;
+            next.swap(frame);
+            frame.clear();
+            Flush();
+        }
+
+        // write as much as the terminal takes without blocking
+        void Flush() {
+            while (true) {
+                if (off == cur.size()) {
+                    if (next.empty())
+                        return;
+                    cur.swap(next);
+                    next.clear();
+                    off = 0;
+                }
+                ssize_t n = write(fd, cur.data() + off, cur.size() - off);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        // terminal is gone, nothing left to converge to
+                        cur.clear();
+                        next.clear();
+                        off = 0;
+                    }
+                    return;
+                }
+                off += static_cast<size_t>(n);
+            }
+        }
+
+        // block until everything is written, e.g. before exiting
+        void Drain() {
+            Flush();
+            while (Pending()) {
+                pollfd pfd{fd, POLLOUT, 0};
+                poll(&pfd, 1, -1);
+                Flush();
+            }
+        }
+
+        // print the frame counters to stderr
+        void Report(const char *name) const {
+            std::fprintf(stderr, "%s: frames=%lu dropped=%lu\n", name,
+                         static_cast<unsigned long>(frames),
+                         static_cast<unsigned long>(dropped));
+        }
+    };
+
+    // Signal an eventfd; a full counter (`EAGAIN`) is already signalled
+    static inline void notify(int fd) {
+        const uint64_t one = 1;
+        while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
         }
     }
 
+    // key press and its arrival time
+    struct KeyEvent {
+        char key;
+        time_point t;
+    };
+
+    // Dedicated stdin reader
+    //
+    // A thread blocks on stdin, timestamps keys as they arrive and hands them
+    // over through a wait-free ring, then signals `fd` (an eventfd) so that
+    // the game loop can sleep on it; rendering never delays reading input.
+    struct Input {
+        spsc::Ring<KeyEvent, 256> ring;
+        int fd = -1;          // readable while keys are queued
+        int stop = -1;        // written to stop the thread
+        uint64_t keys = 0;    // keys read (reader side)
+        uint64_t dropped = 0; // keys lost to a full ring (reader side)
+        std::thread th;
+
+        void Start() {
+            fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            stop = eventfd(0, EFD_CLOEXEC);
+            th = std::thread([this] { Loop(); });
+        }
+
+        void Stop() {
+            notify(stop);
+            th.join();
+            close(stop);
+            close(fd);
+        }
+
+        // clear the wake-up signal; call before draining with `Pop`
+        void Ack() {
+            uint64_t n;
+            // `EAGAIN`: not signalled since the last `Ack`
+            while (read(fd, &n, sizeof(n)) < 0 && errno == EINTR) {
+            }
+        }
+
+        // take the oldest queued key, return false if none
+        bool Pop(KeyEvent &ev) { return ring.Pop(ev); }
+
+        // print the key counters to stderr, after `Stop`
+        void Report(const char *name) const {
+            std::fprintf(stderr, "%s: keys=%lu dropped=%lu\n", name,
+                         static_cast<unsigned long>(keys),
+                         static_cast<unsigned long>(dropped));
+        }
+
+      private:
+        void Loop() {
+            pollfd pfd[2] = {{STDIN_FILENO, POLLIN, 0}, {stop, POLLIN, 0}};
+            char buf[64];
+            while (true) {
+                if (poll(pfd, 2, -1) < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    return;
+                }
+                if (pfd[1].revents)
+                    return;
+                ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+                // keys of one read arrived together
+                const time_point t = steady_clock::now();
+                if (n < 0 && (errno == EAGAIN || errno == EINTR))
+                    continue;
+                if (n <= 0)
+                    return;
+                for (ssize_t i = 0; i < n; ++i) {
+                    if (!ring.Push(KeyEvent{buf[i], t}))
+                        ++dropped;
+                }
+                keys += static_cast<uint64_t>(n);
+                notify(fd);
+            }
+        }
+    };
+
 } // namespace term
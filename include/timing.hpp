@@ -0,0 +1,109 @@
+// ----------------------------------------------------------------------------
+// timing.hpp
+//
+// Game timing: gravity by level, lock delay and auto-shift, all scheduled on
+// one monotonic deadline queue.
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include "core.hpp"
+#include "evlog.hpp"
+#include "metrics.hpp"
+
+namespace timing {
+
+    typedef std::chrono::nanoseconds nsec;
+
+    // time a grounded piece may still move before it locks
+    inline constexpr nsec kLockDelay = std::chrono::milliseconds(500);
+    // moves that restart the lock delay, per piece
+    inline constexpr uint8_t kLockResets = 15;
+    // delayed auto-shift: hold time before a key starts repeating
+    inline constexpr nsec kDAS = std::chrono::milliseconds(167);
+    // auto-repeat rate: time between two repeated moves
+    inline constexpr nsec kARR = std::chrono::milliseconds(33);
+    // A terminal reports no key release, only its own auto-repeat of the
+    // held key, which starts after its repeat delay (250-660 ms, longer than
+    // `kDAS`) and comes every ~30 ms; a pressed key is considered released
+    // if it did not come again within `kRepeatDelay`, and after that when it
+    // stops coming for `kRelease`.
+    inline constexpr nsec kRepeatDelay = std::chrono::milliseconds(700);
+    inline constexpr nsec kRelease = std::chrono::milliseconds(80);
+
+    enum class Event : uint8_t {
+        Gravity = 0, // piece falls one row
+        Lock,        // grounded piece locks
+        Shift,       // held key repeats (DAS, then ARR)
+        Release,     // held key released
+    };
+    inline constexpr uint8_t kNEvent = 4;
+
+    // Deadline queue
+    //
+    // Each event kind has at most one pending deadline, so the queue is a
+    // fixed array scanned for the earliest entry.
+    struct Queue {
+        std::array<time_point, kNEvent> at; // `time_point::max()` if unarmed
+
+        Queue();
+
+        void Arm(const Event &, const time_point &);
+
+        void Disarm(const Event &);
+
+        bool Armed(const Event &) const;
+
+        // earliest deadline
+        Event Next() const;
+    };
+
+    // lateness of fired deadlines
+    struct Jitter {
+        uint64_t n = 0;
+        nsec sum{0};
+        nsec max{0};
+
+        void Add(const nsec &);
+
+        void Report(const char *) const;
+    };
+
+    // Timing of one game
+    //
+    // Deadlines are re-armed from the time they were due, not from the time
+    // they fired, so that late wake-ups do not accumulate drift.
+    struct Engine {
+        Queue q;
+        Jitter jitter;
+        char held = 0;                // auto-shifted key, 0 if none
+        time_point pressed;           // when `held` was pressed
+        time_point last;              // last move by `held` as a key
+        bool repeating = false;       // the terminal repeats `held`
+        uint8_t resets = kLockResets; // lock delay restarts left
+        evlog::Stream *log = nullptr; // events of the game, if logged
+
+        // arm gravity for a new or resumed game
+        void Start(const core::Piece &, const core::Board &);
+
+        // postpone every deadline, e.g. after a pause
+        void Delay(const nsec &, core::Board &);
+
+        // apply a key pressed at the given time, return false if it is not
+        // a movement key
+        bool Key(const char &, const time_point &, core::Piece &,
+                 core::Board &);
+
+        // fire every deadline due at the given time, return true if game over
+        bool Run(const time_point &, core::Piece &, core::Board &);
+
+        // earliest pending deadline
+        time_point Next() const;
+    };
+
+    // block until `fd` is readable, `out` (if not -1) is writable or `until`
+    // is reached, with sub-millisecond precision; return true if `fd` is
+    // readable
+    bool wait(int fd, const time_point &until, int out = -1);
+
+} // namespace timing
@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ai.hpp"
+
+// A placement is judged by the surface it leaves, in the height domain: the
+// piece is dropped with `core::collide` onto the columns filled up to their
+// heights, every cell it covers under its lowest block in a column becomes a
+// hole, and the new heights give the bumpiness and the height of the stack.
+// Rows below the surface are unknown, so line clears are not taken into
+// account; a placement then only depends on the differences between
+// neighbouring heights, which is what the table is indexed by.
+//
+// Table layout (multi-byte fields little-endian)
+//
+// | size      | field                                                      |
+// |-----------|------------------------------------------------------------|
+// |         2 | magic "TA"                                                 |
+// |         1 | version                                                    |
+// |         1 | `kMaxStep`                                                 |
+// |         1 | `WIDTH`                                                    |
+// |         1 | piece types                                                |
+// |         2 | padding                                                    |
+// |         4 | surfaces                                                   |
+// |         4 | padding                                                    |
+// | ...       | one entry per surface and piece type                       |
+//
+// The entry of piece `type` on surface `s` is the byte at `s * types + type`,
+// the move as `rot << 4 | col`. The surface index
+// has one base `2 * kMaxStep + 1` digit per pair of neighbouring columns,
+// holding their height difference plus `kMaxStep`; the leftmost pair is the
+// lowest digit.
+namespace {
+    using core::kNRot;
+    using core::kNType;
+    inline constexpr uint8_t kNDigit = 2 * ai::kMaxStep + 1;
+
+    inline constexpr uint8_t kMagic0 = 'T';
+    inline constexpr uint8_t kMagic1 = 'A';
+    inline constexpr uint8_t kVersion = 1;
+    inline constexpr uint8_t kHeader = 16;
+    inline constexpr uint8_t kEntry = 1;
+
+    // the table is only trusted while every placement can be reached by
+    // rotating near the top and shifting over the stack
+    inline constexpr uint8_t kMaxReach = HEIGHT - 5;
+
+    // games played by `autoplay` end after this many placements at most
+    inline constexpr uint32_t kMaxPlies = 10000;
+
+    static_assert(ai::kNSurface == [] {
+        uint32_t n = 1;
+        for (uint8_t i = 0; i + 1 < WIDTH; ++i) {
+            n *= kNDigit;
+        }
+        return n;
+    }());
+
+    // One rotation of a piece, as columns of blocks: column `dx` spans
+    // heights `low[dx]` to `high[dx]` above the bottom of the piece (the
+    // columns of a tetromino have no gaps)
+    struct Outline {
+        uint8_t rot; // rotations from the spawn state
+        uint8_t w;   // width in columns
+        std::array<uint8_t, NBRK> low;
+        std::array<uint8_t, NBRK> high;
+        // column and height of each cell
+        std::array<uint8_t, NBRK> x;
+        std::array<uint8_t, NBRK> y;
+
+        bool operator==(const Outline &o) const {
+            return w == o.w && low == o.low && high == o.high;
+        }
+    };
+
+    // distinct rotations of one piece
+    struct Outlines {
+        uint8_t n = 0;
+        std::array<Outline, kNRot> at;
+    };
+
+    static inline Outline outline(const brick_t &cur, uint8_t rot) {
+        uint8_t left = WIDTH, right = 0, bottom = 0;
+        for (uint8_t i : cur) {
+            left = std::min<uint8_t>(left, i % WIDTH);
+            right = std::max<uint8_t>(right, i % WIDTH);
+            bottom = std::max<uint8_t>(bottom, i / WIDTH);
+        }
+        Outline o{rot, static_cast<uint8_t>(right - left + 1), {}, {}, {}, {}};
+        o.low.fill(UINT8_MAX);
+        for (uint8_t k = 0; k < NBRK; ++k) {
+            const uint8_t dx = cur[k] % WIDTH - left;
+            const uint8_t y = bottom - cur[k] / WIDTH;
+            o.low[dx] = std::min(o.low[dx], y);
+            o.high[dx] = std::max(o.high[dx], y);
+            o.x[k] = dx;
+            o.y[k] = y;
+        }
+        return o;
+    }
+
+    // cells of `o` with its bottom left at column `x`, `y` rows above the
+    // floor; cells above the board are `IDX_NA`, below it past `TOTAL`
+    static inline brick_t place(const Outline &o, uint8_t x, int y) {
+        brick_t b;
+        for (uint8_t k = 0; k < NBRK; ++k) {
+            const int row = HEIGHT - 1 - y - o.y[k];
+            b[k] = row < 0 ? IDX_NA
+                           : static_cast<uint8_t>(row * WIDTH + x + o.x[k]);
+        }
+        return b;
+    }
+
+    // a stack of columns filled up to `h`
+    static inline void fill(const ai::heights_t &h, field_t &f) {
+        for (uint8_t r = 0; r < HEIGHT; ++r) {
+            for (uint8_t x = 0; x < WIDTH; ++x) {
+                f[r * WIDTH + x] = r + h[x] >= HEIGHT;
+            }
+        }
+    }
+
+    // the rotations of every piece, taken from the game's own rotation
+    // tables by turning a spawned piece on an empty board
+    static const std::array<Outlines, kNType> &outlines() {
+        static const std::array<Outlines, kNType> all = [] {
+            std::array<Outlines, kNType> all;
+            const field_t empty{};
+            for (uint8_t t = 0; t < kNType; ++t) {
+                core::Piece p;
+                p.Spawn(t);
+                // room for the rotations that reach above the spawn rows
+                p.Down();
+                p.Down();
+                for (uint8_t r = 0; r < kNRot; ++r) {
+                    if (r > 0 && !p.Rotate(empty))
+                        break;
+                    const Outline o = outline(p.cur, r);
+                    Outlines &os = all[t];
+                    if (std::find(os.at.begin(), os.at.begin() + os.n, o) ==
+                        os.at.begin() + os.n)
+                        os.at[os.n++] = o;
+                }
+            }
+            return all;
+        }();
+        return all;
+    }
+
+    // write `n` bytes of `v`, little-endian
+    static inline void put(char *out, uint64_t v, uint8_t n) {
+        for (uint8_t i = 0; i < n; ++i) {
+            out[i] = static_cast<char>(v >> (8 * i));
+        }
+    }
+
+    // read `n` bytes, little-endian
+    static inline uint64_t get(const uint8_t *in, uint8_t n) {
+        uint64_t v = 0;
+        for (uint8_t i = 0; i < n; ++i) {
+            v |= static_cast<uint64_t>(in[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    static inline uint8_t leftmost(const brick_t &cur) {
+        uint8_t left = WIDTH;
+        for (uint8_t i : cur) {
+            left = std::min<uint8_t>(left, i % WIDTH);
+        }
+        return left;
+    }
+
+} // namespace
+
+// rows top down until every column met a block; empty rows, most of the
+// board, are skipped with two loads
+void ai::heights(const field_t &base, heights_t &h) {
+    h.fill(0);
+    uint16_t open = (1u << WIDTH) - 1; // columns without a block so far
+    for (uint8_t r = 0; r < HEIGHT && open != 0; ++r) {
+        const uint8_t *row = base.data() + r * WIDTH;
+        uint64_t lo;
+        uint16_t hi;
+        static_assert(sizeof(lo) + sizeof(hi) == WIDTH,
+                      "a row is loaded as one uint64_t and one uint16_t");
+        std::memcpy(&lo, row, sizeof(lo));
+        std::memcpy(&hi, row + sizeof(lo), sizeof(hi));
+        if ((lo | hi) == 0)
+            continue;
+        for (uint8_t x = 0; x < WIDTH; ++x) {
+            if ((open >> x & 1) && row[x] != 0) {
+                h[x] = HEIGHT - r;
+                open &= static_cast<uint16_t>(~(1u << x));
+            }
+        }
+    }
+}
+
+uint32_t ai::surface(const heights_t &h) {
+    uint32_t s = 0;
+    for (uint8_t x = WIDTH - 1; x > 0; --x) {
+        const int d = h[x] - h[x - 1] + kMaxStep;
+        if (d < 0 || d >= kNDigit)
+            return kNSurface;
+        s = s * kNDigit + static_cast<uint32_t>(d);
+    }
+    return s;
+}
+
+uint16_t ai::search(uint8_t type, const heights_t &h, Move &best) {
+    const int base = *std::min_element(h.begin(), h.end());
+    field_t f;
+    fill(h, f);
+    uint16_t best_cost = UINT16_MAX;
+    const Outlines &os = outlines()[type % kNType];
+    for (uint8_t i = 0; i < os.n; ++i) {
+        const Outline &o = os.at[i];
+        for (uint8_t x = 0; x + o.w <= WIDTH; ++x) {
+            // drop from the top of the highest column under the piece, where
+            // only the top of the board can be in the way, until it rests
+            int y = 0;
+            for (uint8_t dx = 0; dx < o.w; ++dx) {
+                y = std::max<int>(y, h[x + dx]);
+            }
+            if (core::collide(place(o, x, y), f))
+                continue;
+            while (!core::collide(place(o, x, y - 1), f)) {
+                --y;
+            }
+            int holes = 0;
+            std::array<int, WIDTH> n;
+            std::copy(h.begin(), h.end(), n.begin());
+            for (uint8_t dx = 0; dx < o.w; ++dx) {
+                holes += y + o.low[dx] - h[x + dx];
+                n[x + dx] = y + o.high[dx] + 1;
+            }
+            int bump = 0;
+            int top = n[0];
+            for (uint8_t c = 1; c < WIDTH; ++c) {
+                bump += std::abs(n[c] - n[c - 1]);
+                top = std::max(top, n[c]);
+            }
+            const uint16_t cost = static_cast<uint16_t>(
+                16 * holes + 3 * bump + 2 * (y - base) + (top - base));
+            if (cost < best_cost) {
+                best_cost = cost;
+                best = Move{o.rot, x};
+            }
+        }
+    }
+    return best_cost;
+}
+
+ai::Table::~Table() {
+    if (data != nullptr)
+        munmap(const_cast<uint8_t *>(data), size);
+}
+
+bool ai::Table::Open(const char *path) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *m = MAP_FAILED;
+    if (fstat(fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) ==
+            kHeader + size_t{kNSurface} * kNType * kEntry) {
+        // fault the whole table in now rather than on the first lookups of
+        // the game
+        m = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                 MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    }
+    close(fd);
+    if (m == MAP_FAILED)
+        return false;
+    const auto *u = static_cast<const uint8_t *>(m);
+    const uint64_t n = get(u + 8, 4);
+    if (u[0] != kMagic0 || u[1] != kMagic1 || u[2] != kVersion ||
+        u[3] != kMaxStep || u[4] != WIDTH || u[5] != kNType ||
+        n != kNSurface) {
+        munmap(m, static_cast<size_t>(st.st_size));
+        return false;
+    }
+    data = u;
+    size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+bool ai::Table::Get(uint8_t type, const heights_t &h, Move &m) const {
+    const uint32_t s = surface(h);
+    if (data == nullptr || s == kNSurface)
+        return false;
+    const uint8_t e =
+        data[kHeader + (size_t{s} * kNType + type % kNType) * kEntry];
+    m = Move{static_cast<uint8_t>(e >> 4), static_cast<uint8_t>(e & 0x0F)};
+    return true;
+}
+
+bool ai::choose(const Table &t, const core::Piece &p, const core::Board &b,
+                Move &m) {
+    heights_t h;
+    heights(b.base, h);
+    const uint8_t type = p.state / kNRot;
+    if (*std::max_element(h.begin(), h.end()) <= kMaxReach &&
+        t.Get(type, h, m))
+        return true;
+    search(type, h, m);
+    return false;
+}
+
+bool ai::apply(const Move &m, core::Piece &p, const core::Board &b) {
+    bool ok = true;
+    for (uint8_t r = 0; ok && r < m.rot; ++r) {
+        const uint8_t state = p.state;
+        core::input('k', p, b);
+        ok = p.state != state;
+    }
+    while (ok && leftmost(p.cur) != m.col) {
+        const brick_t before = p.cur;
+        core::input(leftmost(p.cur) < m.col ? 'l' : 'h', p, b);
+        ok = p.cur != before;
+    }
+    while (!core::collide(p.down, b.base)) {
+        p.Down();
+    }
+    return ok;
+}
+
+int ai::generate(const char *path) {
+    const time_point t0 = steady_clock::now();
+    std::vector<char> out(kHeader + size_t{kNSurface} * kNType * kEntry);
+    out[0] = kMagic0;
+    out[1] = kMagic1;
+    out[2] = kVersion;
+    out[3] = kMaxStep;
+    out[4] = WIDTH;
+    out[5] = kNType;
+    put(out.data() + 8, kNSurface, 4);
+
+    heights_t h;
+    char *e = out.data() + kHeader;
+    for (uint32_t s = 0; s < kNSurface; ++s) {
+        // digits left to right, see `surface`; the lowest column is 0
+        h[0] = 0;
+        int low = 0;
+        std::array<int, WIDTH> abs{};
+        for (uint32_t x = 1, d = s; x < WIDTH; ++x, d /= kNDigit) {
+            abs[x] = abs[x - 1] + static_cast<int>(d % kNDigit) - kMaxStep;
+            low = std::min(low, abs[x]);
+        }
+        for (uint8_t x = 0; x < WIDTH; ++x) {
+            h[x] = static_cast<uint8_t>(abs[x] - low);
+        }
+        for (uint8_t t = 0; t < kNType; ++t, e += kEntry) {
+            Move m{};
+            search(t, h, m);
+            e[0] = static_cast<char>(m.rot << 4 | m.col);
+        }
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(out.data(), static_cast<std::streamsize>(out.size()))) {
+        std::cerr << "Failed to save table: " << path << std::endl;
+        return 1;
+    }
+    const double secs =
+        std::chrono::duration<double>(steady_clock::now() - t0).count();
+    std::printf("surfaces=%u entries=%u bytes=%zu time=%.1fs\n", kNSurface,
+                kNSurface * kNType, out.size(), secs);
+    return 0;
+}
+
+int ai::autoplay(const char *path, uint32_t games, uint64_t seed) {
+    Table t;
+    if (std::strcmp(path, "-") != 0 && !t.Open(path)) {
+        std::cerr << "Invalid table: " << path << std::endl;
+        return 1;
+    }
+
+    using ns_f = std::chrono::duration<double, std::nano>;
+    uint64_t placements = 0, lines = 0, hits = 0, blocked = 0;
+    steady_clock::duration hit_time{0}, miss_time{0};
+    for (uint32_t g = 0; g < games; ++g) {
+        core::Board b(seed + g);
+        core::Piece p;
+        p.Spawn(b.Pop());
+        bool over = core::collide(p.down, b.base);
+        uint32_t n = 0;
+        while (!over && n < kMaxPlies) {
+            Move m;
+            const time_point t0 = steady_clock::now();
+            const bool hit = choose(t, p, b, m);
+            const steady_clock::duration d = steady_clock::now() - t0;
+            (hit ? hit_time : miss_time) += d;
+            hits += hit;
+            blocked += !apply(m, p, b);
+            over = core::land(p, b);
+            ++n;
+        }
+        placements += n;
+        lines += b.lines;
+    }
+
+    const uint64_t misses = placements - hits;
+    std::printf("games=%u placements=%lu lines=%lu lines/game=%.1f "
+                "table=%.1f%% blocked=%lu\n",
+                games, static_cast<unsigned long>(placements),
+                static_cast<unsigned long>(lines),
+                static_cast<double>(lines) / std::max(games, 1u),
+                100.0 * static_cast<double>(hits) /
+                    static_cast<double>(std::max<uint64_t>(placements, 1)),
+                static_cast<unsigned long>(blocked));
+    std::printf("decision: table=%.1fns search=%.1fns\n",
+                ns_f(hit_time).count() / std::max<uint64_t>(hits, 1),
+                ns_f(miss_time).count() / std::max<uint64_t>(misses, 1));
+    return 0;
+}
@@ -0,0 +1,432 @@
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <random>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.hpp"
+#include "core.hpp"
+
+// Pipeline
+//
+// Every frame of a headless game runs the stages below in order; `Land` and
+// `Spawn` only run on the frame a piece lands:
+//
+// - step: apply the next key of the placement (`core::input`), then gravity
+//   (`Piece::Down`); this is the gravity of `timing::Engine::Run` without
+//   its deadlines
+// - land: `Board::UpdateActive` then `Board::Land`
+// - spawn: `Piece::Spawn` of `Board::Pop`, and the game over check
+// - update: `Board::UpdateActive`
+// - render: `core::ToString`
+//
+// The corpus is a fixed set of seeds played with a fixed random policy
+// (a rotation and a shift per placement), so two runs execute the exact same
+// work. It is played twice: once bare for the wall-clock cost of the whole
+// pipeline, once with the counters of each stage enabled around its calls
+// only. Counting starts and stops with an `ioctl`, so the stages are measured
+// in place (caches and branch predictors warmed by the stages before them)
+// without reading the counters per call; the kernel side is excluded. When
+// the hardware counters are not available (e.g. in most VMs), stages are
+// timed with `steady_clock` instead. Either way, what an empty measurement
+// costs (the user side of the `ioctl` pair and what it evicts, or the two
+// clock reads) is measured first and taken out of every call.
+namespace {
+
+    inline constexpr uint32_t kGames = 500;
+    inline constexpr uint64_t kSeed = 1;
+    // games end after this many placements at most
+    inline constexpr uint32_t kMaxPlacements = 1000;
+    // empty measurements per stage, for the cost of measuring
+    inline constexpr uint32_t kCalibrate = 100000;
+
+    enum class Stage : uint8_t {
+        Step = 0,
+        Land,
+        Spawn,
+        Update,
+        Render,
+    };
+    inline constexpr uint8_t kNStage = 5;
+    inline constexpr std::array<const char *, kNStage> kArrStageName = {
+        "step", "land", "spawn", "update", "render"};
+
+    // Hardware events, in the order of `Sample::v`
+    struct Event {
+        uint32_t type;
+        uint64_t config;
+        const char *name;
+    };
+    inline constexpr uint8_t kNEvent = 5;
+    inline constexpr uint8_t kCycles = 0;
+    inline constexpr uint8_t kInstructions = 1;
+    inline constexpr std::array<Event, kNEvent> kArrEvent = {{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instr"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "br_miss"},
+        {PERF_TYPE_HW_CACHE,
+         PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+             PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+         "l1d_miss"},
+        {PERF_TYPE_HW_CACHE,
+         PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+             PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+         "llc_miss"},
+    }};
+
+    // Counters of one stage, opened as one group so that they are scheduled
+    // together
+    struct Group {
+        int leader = -1;                   // -1 if no counter is available
+        std::array<int, kNEvent> fd{};     // -1 if the event is not available
+        std::array<uint8_t, kNEvent> slot; // position in the group read
+
+        void Open() {
+            uint8_t n = 0;
+            for (uint8_t e = 0; e < kNEvent; ++e) {
+                perf_event_attr a{};
+                a.size = sizeof(a);
+                a.type = kArrEvent[e].type;
+                a.config = kArrEvent[e].config;
+                a.disabled = leader < 0;
+                a.exclude_kernel = 1;
+                a.exclude_hv = 1;
+                a.read_format = PERF_FORMAT_GROUP |
+                                PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                PERF_FORMAT_TOTAL_TIME_RUNNING;
+                fd[e] = static_cast<int>(
+                    syscall(SYS_perf_event_open, &a, 0, -1, leader, 0));
+                if (fd[e] < 0)
+                    continue;
+                if (leader < 0)
+                    leader = fd[e];
+                slot[e] = n++;
+            }
+        }
+
+        void Close() {
+            for (int f : fd) {
+                if (f >= 0)
+                    close(f);
+            }
+        }
+
+        void Enable() const {
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        void Disable() const {
+            ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        // read the totals into `out`, scaled if the group was multiplexed;
+        // -1 for events that are not available
+        void Read(std::array<double, kNEvent> &out) const {
+            out.fill(-1);
+            uint64_t buf[3 + kNEvent];
+            if (leader < 0 || read(leader, buf, sizeof(buf)) <= 0)
+                return;
+            const double scale =
+                buf[2] ? static_cast<double>(buf[1]) / buf[2] : 0;
+            for (uint8_t e = 0; e < kNEvent; ++e) {
+                if (fd[e] >= 0)
+                    out[e] = static_cast<double>(buf[3 + slot[e]]) * scale;
+            }
+        }
+    };
+
+    // One stage under measurement
+    struct Meter {
+        Group g;
+        bool timed = false; // time calls with `steady_clock`
+        uint64_t calls = 0;
+        steady_clock::duration time{0};
+    };
+
+    template <typename F> static inline void measure(Meter &m, F &&f) {
+        ++m.calls;
+        if (m.g.leader >= 0) {
+            m.g.Enable();
+            f();
+            m.g.Disable();
+        } else if (m.timed) {
+            const time_point t0 = steady_clock::now();
+            f();
+            m.time += steady_clock::now() - t0;
+        } else {
+            f();
+        }
+    }
+
+    struct Totals {
+        uint64_t placements = 0;
+        uint64_t frames = 0;
+    };
+
+    // play the corpus, measuring each stage with `meters`
+    static Totals play(std::array<Meter, kNStage> &meters) {
+        Totals t;
+        std::mt19937_64 policy(kSeed);
+        std::array<std::string, HEIGHT> screen;
+        std::string keys;
+        auto &[step, land, spawn, update, render] = meters;
+
+        for (uint32_t g = 0; g < kGames; ++g) {
+            core::Board b(kSeed + g);
+            core::Piece p;
+            bool over = false;
+            measure(spawn, [&] {
+                p.Spawn(b.Pop());
+                over = core::collide(p.down, b.base);
+            });
+
+            uint32_t n = 0;
+            size_t k = 0;
+            keys.clear();
+            while (!over && n < kMaxPlacements) {
+                if (k == keys.size()) {
+                    // new piece: pick a rotation and a shift
+                    keys.assign(policy() % 4, 'k');
+                    const int shift =
+                        static_cast<int>(policy() % WIDTH) - WIDTH / 2;
+                    keys.append(std::abs(shift), shift < 0 ? 'h' : 'l');
+                    k = 0;
+                }
+
+                bool landed = false;
+                measure(step, [&] {
+                    if (k < keys.size())
+                        core::input(keys[k++], p, b);
+                    landed = core::collide(p.down, b.base);
+                    if (!landed)
+                        p.Down();
+                });
+                if (landed) {
+                    measure(land, [&] {
+                        b.UpdateActive(p.cur);
+                        b.Land();
+                    });
+                    measure(spawn, [&] {
+                        p.Spawn(b.Pop());
+                        over = core::collide(p.down, b.base);
+                    });
+                    k = keys.size();
+                    ++n;
+                }
+                measure(update, [&] { b.UpdateActive(p.cur); });
+                measure(render, [&] { core::ToString(b.active, screen); });
+                ++t.frames;
+            }
+            t.placements += n;
+        }
+        return t;
+    }
+
+    // per-call results of one stage, -1 if not measured
+    struct Result {
+        std::array<double, kNEvent> ev;
+        double ns;
+    };
+
+    // baseline file: one line per stage, then the pipeline
+    //
+    //   <stage> <cycles> <instructions> ... <ns>   (per call)
+    //   pipeline <ns per frame> <ns per placement>
+    static bool load(const char *path, std::array<Result, kNStage> &stages,
+                     double &frame_ns, double &placement_ns) {
+        FILE *f = std::fopen(path, "r");
+        if (f == nullptr)
+            return false;
+        char name[32];
+        bool ok = true;
+        for (uint8_t s = 0; ok && s < kNStage; ++s) {
+            Result &r = stages[s];
+            ok = std::fscanf(f, "%31s %lf %lf %lf %lf %lf %lf", name,
+                             &r.ev[0], &r.ev[1], &r.ev[2], &r.ev[3],
+                             &r.ev[4], &r.ns) == 7 &&
+                 std::strcmp(name, kArrStageName[s]) == 0;
+        }
+        ok = ok &&
+             std::fscanf(f, "%31s %lf %lf", name, &frame_ns,
+                         &placement_ns) == 3 &&
+             std::strcmp(name, "pipeline") == 0;
+        std::fclose(f);
+        return ok;
+    }
+
+    static bool store(const char *path,
+                      const std::array<Result, kNStage> &stages,
+                      double frame_ns, double placement_ns) {
+        FILE *f = std::fopen(path, "w");
+        if (f == nullptr)
+            return false;
+        for (uint8_t s = 0; s < kNStage; ++s) {
+            const Result &r = stages[s];
+            std::fprintf(f, "%s %.3f %.3f %.3f %.3f %.3f %.3f\n",
+                         kArrStageName[s], r.ev[0], r.ev[1], r.ev[2],
+                         r.ev[3], r.ev[4], r.ns);
+        }
+        std::fprintf(f, "pipeline %.3f %.3f\n", frame_ns, placement_ns);
+        return std::fclose(f) == 0;
+    }
+
+    // print one value, `-` if not measured
+    static inline void cell(double v) {
+        if (v < 0) {
+            std::printf(" %10s", "-");
+        } else {
+            std::printf(" %10.1f", v);
+        }
+    }
+
+    // relative change of `v` against `base`, `-` if either is missing
+    static inline void change(double v, double base) {
+        if (v < 0 || base <= 0) {
+            std::printf(" %10s", "-");
+        } else {
+            std::printf(" %+9.1f%%", (v - base) / base * 100);
+        }
+    }
+
+    static inline double ipc(const Result &r) {
+        return r.ev[kCycles] > 0 && r.ev[kInstructions] >= 0
+                   ? r.ev[kInstructions] / r.ev[kCycles]
+                   : -1;
+    }
+
+} // namespace
+
+int bench::run(const char *path, bool save) {
+    using ns_f = std::chrono::duration<double, std::nano>;
+
+    // bare run: wall-clock cost of the whole pipeline
+    std::array<Meter, kNStage> bare;
+    const time_point t0 = steady_clock::now();
+    const Totals t = play(bare);
+    const double total_ns = ns_f(steady_clock::now() - t0).count();
+    const double frame_ns = total_ns / static_cast<double>(t.frames);
+    const double placement_ns =
+        total_ns / static_cast<double>(std::max<uint64_t>(t.placements, 1));
+
+    // instrumented run: counters (or time) per stage, less those of an
+    // empty measurement
+    std::array<Meter, kNStage> meters;
+    std::array<Result, kNStage> empty;
+    bool counted = true;
+    for (uint8_t s = 0; s < kNStage; ++s) {
+        Meter &m = meters[s];
+        m.g.Open();
+        m.timed = m.g.leader < 0;
+        counted = counted && !m.timed;
+        for (uint32_t i = 0; i < kCalibrate; ++i) {
+            measure(m, [] {});
+        }
+        // the group counts on, its totals are taken out after the run
+        m.g.Read(empty[s].ev);
+        empty[s].ns = ns_f(m.time).count();
+        m.calls = 0;
+        m.time = steady_clock::duration{0};
+    }
+    play(meters);
+
+    std::array<Result, kNStage> stages;
+    for (uint8_t s = 0; s < kNStage; ++s) {
+        Meter &m = meters[s];
+        Result &r = stages[s];
+        const Result &e = empty[s];
+        const double calls =
+            static_cast<double>(std::max<uint64_t>(m.calls, 1));
+        m.g.Read(r.ev);
+        for (uint8_t i = 0; i < kNEvent; ++i) {
+            if (r.ev[i] >= 0)
+                r.ev[i] = std::max(
+                    (r.ev[i] - e.ev[i]) / calls - e.ev[i] / kCalibrate, 0.0);
+        }
+        r.ns = m.timed ? std::max(ns_f(m.time).count() / calls -
+                                      e.ns / kCalibrate,
+                                  0.0)
+                       : -1;
+        m.g.Close();
+    }
+
+    std::printf("bench: games=%u placements=%lu frames=%lu counters=%s\n",
+                kGames, static_cast<unsigned long>(t.placements),
+                static_cast<unsigned long>(t.frames),
+                counted ? "hardware" : "unavailable, timing stages");
+    std::printf("pipeline: %.1f ns/frame %.1f ns/placement\n", frame_ns,
+                placement_ns);
+
+    // per call, then the sum of all stages per frame and per placement
+    std::printf("\n%-10s %10s", "per call", "calls");
+    for (const auto &e : kArrEvent) {
+        std::printf(" %10.10s", e.name);
+    }
+    std::printf(" %10s %10s\n", "ipc", "ns");
+    std::array<double, kNEvent + 1> sum{};
+    for (uint8_t s = 0; s < kNStage; ++s) {
+        const Result &r = stages[s];
+        std::printf("%-10s %10lu", kArrStageName[s],
+                    static_cast<unsigned long>(meters[s].calls));
+        for (uint8_t e = 0; e < kNEvent; ++e) {
+            cell(r.ev[e]);
+            sum[e] += std::max(r.ev[e], 0.0) * meters[s].calls;
+        }
+        cell(ipc(r));
+        cell(r.ns);
+        std::printf("\n");
+        sum[kNEvent] += std::max(r.ns, 0.0) * meters[s].calls;
+    }
+    for (const auto &[name, n] : {std::make_pair("frame", t.frames),
+                                  std::make_pair("placement", t.placements)}) {
+        std::printf("%-10s %10s", name, "");
+        for (uint8_t e = 0; e < kNEvent; ++e) {
+            cell(stages[0].ev[e] < 0 ? -1 : sum[e] / std::max<uint64_t>(n, 1));
+        }
+        cell(counted ? sum[kInstructions] / sum[kCycles] : -1);
+        cell(counted ? -1 : sum[kNEvent] / std::max<uint64_t>(n, 1));
+        std::printf("\n");
+    }
+
+    std::array<Result, kNStage> base;
+    double base_frame_ns, base_placement_ns;
+    if (path == nullptr)
+        return 0;
+    if (!save && load(path, base, base_frame_ns, base_placement_ns)) {
+        // per-call changes; ipc as an absolute difference
+        std::printf("\n%-10s %10s", "vs base", "");
+        for (const auto &e : kArrEvent) {
+            std::printf(" %10.10s", e.name);
+        }
+        std::printf(" %10s %10s\n", "ipc", "ns");
+        for (uint8_t s = 0; s < kNStage; ++s) {
+            std::printf("%-10s %10s", kArrStageName[s], "");
+            for (uint8_t e = 0; e < kNEvent; ++e) {
+                change(stages[s].ev[e], base[s].ev[e]);
+            }
+            if (ipc(stages[s]) < 0 || ipc(base[s]) < 0) {
+                std::printf(" %10s", "-");
+            } else {
+                std::printf(" %+10.2f", ipc(stages[s]) - ipc(base[s]));
+            }
+            change(stages[s].ns, base[s].ns);
+            std::printf("\n");
+        }
+        std::printf("pipeline:");
+        change(frame_ns, base_frame_ns);
+        std::printf(" per frame,");
+        change(placement_ns, base_placement_ns);
+        std::printf(" per placement\n");
+        return 0;
+    }
+    if (!store(path, stages, frame_ns, placement_ns)) {
+        std::perror(path);
+        return 1;
+    }
+    std::printf("\nbaseline saved to %s\n", path);
+    return 0;
+}
@@ -14,11 +14,15 @@ namespace {
     inline static constexpr std::array<const char[3], kNCell> kArrCellStr = {
         "  ", "[]"};
 
-    // Generate a random integer within uint8_t range
-    static inline uint8_t rand_int() {
-        static thread_local std::mt19937 rng(std::random_device{}());
-        std::uniform_int_distribution<uint8_t> dist(0, UINT8_MAX);
-        return dist(rng);
+    // Generate a random integer within uint8_t range (splitmix64)
+    //
+    // The whole generator state is the 64-bit `state`, kept in `Board` so
+    // that a game can be saved and replayed.
+    static inline uint8_t rand_int(uint64_t &state) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return static_cast<uint8_t>((z ^ (z >> 31)) >> 56);
     }
 
     // check if a row is full
@@ -44,6 +48,25 @@ namespace {
                   static_cast<uint8_t>(Pixel::NUL));
     }
 
+    // Gravity per level (guideline curve), level 1 being the historical
+    // 1 cell per second; the level goes up every 10 lines
+    inline constexpr uint8_t kNLevel = 20;
+    inline constexpr uint8_t kLinesPerLevel = 10;
+    static constexpr std::array<std::chrono::nanoseconds, kNLevel>
+        kArrGravity = [] {
+            std::array<std::chrono::nanoseconds, kNLevel> out{};
+            for (uint8_t i = 0; i < kNLevel; ++i) {
+                // (0.8 - (level - 1) * 0.007) ^ (level - 1) seconds
+                double s = 1.0;
+                for (uint8_t k = 0; k < i; ++k) {
+                    s *= 0.8 - i * 0.007;
+                }
+                out[i] =
+                    std::chrono::nanoseconds(static_cast<int64_t>(s * 1e9));
+            }
+            return out;
+        }();
+
     // convert pixel to string for terminal display
     std::string px2str(const uint8_t idx) { return kArrCellStr[idx]; }
 
@@ -51,7 +74,13 @@ namespace {
 
 // constructor
 core::Board::Board()
-    : last_fall(steady_clock::now()), lines(0), next(rand_int()) {
+    : Board((static_cast<uint64_t>(std::random_device{}()) << 32) |
+            std::random_device{}()) {}
+
+// constructor with a fixed generator seed
+core::Board::Board(const uint64_t &seed)
+    : last_fall(steady_clock::now()), rng(seed), lines(0),
+      next(rand_int(rng)) {
     std::fill(base.begin(), base.end(), static_cast<uint8_t>(Pixel::NUL));
     std::fill(active.begin(), active.end(), static_cast<uint8_t>(Pixel::NUL));
 }
@@ -59,7 +88,7 @@ core::Board::Board()
 uint8_t core::Board::Pop() {
     uint8_t next_type = this->next;
     // update next piece
-    this->next = rand_int();
+    this->next = rand_int(this->rng);
     return next_type;
 }
 
@@ -108,28 +137,40 @@ bool core::collide(const brick_t &indices, const field_t &mx) {
     return false;
 }
 
-// run one step of the game loop (piece falling), return true if game over,
-// false otherwise
-bool core::step(core::Piece &p, core::Board &b) {
-    if (duration_cast<sec>(steady_clock::now() - b.last_fall).count() >= 1) {
-        b.last_fall = steady_clock::now();
-        // move down if possible
-        // add to board otherwise
-        if (!core::collide(p.down, b.base)) {
+// time between two falls at the level reached after clearing `lines`
+steady_clock::duration core::gravity(const uint16_t &lines) {
+    return kArrGravity[std::min<uint16_t>(lines / kLinesPerLevel, kNLevel - 1)];
+}
+
+// land the piece and spawn the next one, return true if game over
+bool core::land(core::Piece &p, core::Board &b) {
+    // Land the piece, update the base board, and optionaly clear full lines
+    b.UpdateActive(p.cur);
+    b.Land();
+    // initiate new piece
+    p.Spawn(b.Pop());
+    // check if the game is over
+    return core::collide(p.down, b.base);
+}
+
+// apply a movement key (`h`, `l`, `k`, `j`) to the piece if the target
+// position is free; return false if the key is not a movement key
+bool core::input(const char &key, core::Piece &p, const core::Board &b) {
+    if (key == 'h') {
+        if (!core::collide(p.left, b.base))
+            p.Left();
+    } else if (key == 'l') {
+        if (!core::collide(p.right, b.base))
+            p.Right();
+    } else if (key == 'k') {
+        p.Rotate(b.base);
+    } else if (key == 'j') {
+        if (!core::collide(p.down, b.base))
             p.Down();
-        } else {
-            // Land the piece, update the base board, and optionaly clear full
-            // lines
-            b.Land();
-            // initiate new piece
-            p.Spawn(b.Pop());
-            // check if the game is over
-            if (core::collide(p.down, b.base)) {
-                return true;
-            }
-        }
+    } else {
+        return false;
     }
-    return false;
+    return true;
 }
 
 // visualize the board matrix
@@ -1,121 +1,156 @@
-#include <tuple>
-
 #include "core.hpp"
 
-// Pieces i.e. tetrominos
-//
-// O0: [0][1]
-//     [2][3]
-//
-// I0:               I1: [0]
-//     [0][1][2][3]      [1]
-//                       [2]
-//                       [3]
+// Pieces i.e. tetrominos, in their spawn orientation (state 0) following the
+// Super Rotation System (SRS); `P` marks the pivot, which is always cell 0
 //
-// T0:               T1: [0]           T2:    [0]        T3:    [0]
-//     [0][1][2]         [1][2]            [1][2][3]         [1][2]
-//        [3]            [3]                                    [3]
+// O: [ ][ ]     I: [ ][P][ ][ ]     T:    [ ]
+//    [P][ ]                            [ ][P][ ]
 //
-// Z0:               Z1:    [0]
-//     [0][1]            [1][2]
-//        [2][3]         [3]
+// Z: [ ][ ]     S:    [ ][ ]        L:       [ ]     J: [ ]
+//       [P][ ]     [ ][P]              [ ][P][ ]        [ ][P][ ]
 //
-// S0:               S1: [0]
-//        [0][1]         [1][2]
-//     [2][3]               [3]
-//
-// L0: [0]           L1:       [0]     L2: [0][1]        L3:
-//     [1]               [1][2][3]            [2]            [0][1][2]
-//     [2][3]                                 [3]            [3]
-//
-// J0:    [0]        L1:               L2: [0][1]        L3:
-//        [1]            [0][1][2]         [2]               [0]
-//     [2][3]                  [3]         [3]               [1][2][3]
+// Each piece has four rotation states (0, R, 2, L); a rotation turns the
+// cells clockwise around the pivot, then tries the SRS kicks of the piece in
+// order, keeping the first position that does not collide. Everything but
+// `kArrDef` (and the kick offsets it points to) is generated at compile time
+// from it.
 namespace {
 
-    // Number of initial states, and we happen to give one for each piece type
-    static constexpr uint8_t kNStateInit = 7;
-    // Number of piece orientation states
-    static constexpr uint8_t kNState = 19;
-
-    // Rotating Orientation
-    enum class State : uint8_t {
-        O0 = 0,
-        I0,
-        I1,
-        T0,
-        T1,
-        T2,
-        T3,
-        Z0,
-        Z1,
-        S0,
-        S1,
-        L0,
-        L1,
-        L2,
-        L3,
-        J0,
-        J1,
-        J2,
-        J3,
+    // x to the right, y down, as on the board
+    struct Vec {
+        int8_t x;
+        int8_t y;
     };
+    typedef std::array<Vec, NBRK> cells_t;
+
+    using core::kNRot;
+    // Maximum number of positions tried per rotation
+    inline constexpr uint8_t kNKick = 5;
 
-    // Initial states of the pieces
+    // SRS offsets of one family of pieces, per rotation state
     //
-    // NOTE: pieces should always follow the top-down, left-right order, which
-    // is the convention that rotation / around functions follow, otherwise
-    // the piece will be misplaced after rotation
-    static constexpr std::array<std::pair<uint8_t, brick_t>, kNStateInit>
-        kMapBrickInit = {
-            std::make_pair(static_cast<uint8_t>(State::O0),
-                           brick_t{4, 5, 14, 15}),
-            std::make_pair(static_cast<uint8_t>(State::I0),
-                           brick_t{3, 4, 5, 6}),
-            std::make_pair(static_cast<uint8_t>(State::T0),
-                           brick_t{4, 5, 6, 15}),
-            std::make_pair(static_cast<uint8_t>(State::Z0),
-                           brick_t{4, 5, 15, 16}),
-            std::make_pair(static_cast<uint8_t>(State::S0),
-                           brick_t{5, 6, 14, 15}),
-            std::make_pair(static_cast<uint8_t>(State::L0),
-                           brick_t{4, 14, 24, 25}),
-            std::make_pair(static_cast<uint8_t>(State::J0),
-                           brick_t{5, 15, 24, 25}),
+    // NOTE: y up, as in the guideline tables; the kicks of a rotation from
+    // state `a` to state `b` are `at[a][i] - at[b][i]`
+    struct Offsets {
+        uint8_t n; // kicks per rotation
+        std::array<std::array<Vec, kNKick>, kNRot> at;
     };
 
-    static constexpr std::array<char, kNStateInit> kArrShapeInit = {
-        'O', 'I', 'T', 'Z', 'S', 'L', 'J',
+    inline constexpr Offsets kOffsetsJLSTZ = {
+        kNKick,
+        {{
+            {{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}},     // 0
+            {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},    // R
+            {{{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}}},     // 2
+            {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}, // L
+        }},
     };
 
-    static constexpr std::array<uint8_t, kNState> kMapState2Next = {
-        static_cast<uint8_t>(State::O0), // trivial
-        static_cast<uint8_t>(State::I1), // I0 -> I1
-        static_cast<uint8_t>(State::I0), // I1 -> I0
-        static_cast<uint8_t>(State::T1), // T0 -> T1
-        static_cast<uint8_t>(State::T2), // T1 -> T2
-        static_cast<uint8_t>(State::T3), // T2 -> T3
-        static_cast<uint8_t>(State::T0), // T3 -> T0
-        static_cast<uint8_t>(State::Z1), // Z0 -> Z1
-        static_cast<uint8_t>(State::Z0), // Z1 -> Z0
-        static_cast<uint8_t>(State::S1), // S0 -> S1
-        static_cast<uint8_t>(State::S0), // S1 -> S0
-        static_cast<uint8_t>(State::L1), // L0 -> L1
-        static_cast<uint8_t>(State::L2), // L1 -> L2
-        static_cast<uint8_t>(State::L3), // L2 -> L3
-        static_cast<uint8_t>(State::L0), // L3 -> L0
-        static_cast<uint8_t>(State::J1), // J0 -> J1
-        static_cast<uint8_t>(State::J2), // J1 -> J2
-        static_cast<uint8_t>(State::J3), // J2 -> J3
-        static_cast<uint8_t>(State::J0), // J3 -> J0
+    inline constexpr Offsets kOffsetsI = {
+        kNKick,
+        {{
+            {{{0, 0}, {-1, 0}, {2, 0}, {-1, 0}, {2, 0}}},   // 0
+            {{{-1, 0}, {0, 0}, {0, 0}, {0, 1}, {0, -2}}},   // R
+            {{{-1, 1}, {1, 1}, {-2, 1}, {1, 0}, {-2, 0}}},  // 2
+            {{{0, 1}, {0, 1}, {0, 1}, {0, -1}, {0, 2}}},    // L
+        }},
     };
 
+    // the O piece does not kick, its offsets only undo the turn around a
+    // corner cell
+    inline constexpr Offsets kOffsetsO = {
+        1,
+        {{
+            {{{0, 0}}},   // 0
+            {{{0, -1}}},  // R
+            {{{-1, -1}}}, // 2
+            {{{-1, 0}}},  // L
+        }},
+    };
+
+    // Piece definition
+    struct Def {
+        char shape;             // shown as the next piece
+        uint8_t spawn;          // board index of the pivot on spawn
+        cells_t cells;          // state 0, relative to the pivot (cell 0)
+        const Offsets *offsets; // SRS offsets
+    };
+
+    // NOTE: to add a piece, append it here and count it in `core::kNType`
+    inline constexpr std::array kArrDef = {
+        Def{'O', 14, {{{0, 0}, {1, 0}, {0, -1}, {1, -1}}}, &kOffsetsO},
+        Def{'I', 4, {{{0, 0}, {-1, 0}, {1, 0}, {2, 0}}}, &kOffsetsI},
+        Def{'T', 14, {{{0, 0}, {-1, 0}, {1, 0}, {0, -1}}}, &kOffsetsJLSTZ},
+        Def{'Z', 14, {{{0, 0}, {-1, -1}, {0, -1}, {1, 0}}}, &kOffsetsJLSTZ},
+        Def{'S', 14, {{{0, 0}, {-1, 0}, {0, -1}, {1, -1}}}, &kOffsetsJLSTZ},
+        Def{'L', 14, {{{0, 0}, {-1, 0}, {1, 0}, {1, -1}}}, &kOffsetsJLSTZ},
+        Def{'J', 14, {{{0, 0}, {-1, 0}, {1, 0}, {-1, -1}}}, &kOffsetsJLSTZ},
+    };
+
+    using core::kNType;
+    static_assert(kArrDef.size() == kNType);
+    // Number of piece states (`Piece::state`), `type * kNRot + rotation`
+    inline constexpr uint8_t kNState = kNType * kNRot;
+
+    // state reached by a clockwise rotation
     static inline constexpr uint8_t next_state(const uint8_t state) {
-        if (state >= kNState)
-            throw std::out_of_range("Invalid state");
-        return kMapState2Next[state];
+        return state - state % kNRot + (state + 1) % kNRot;
     }
 
+    // Cells of each state relative to the pivot
+    static constexpr std::array<cells_t, kNState> kArrCells = [] {
+        std::array<cells_t, kNState> out{};
+        for (uint8_t t = 0; t < kNType; ++t) {
+            cells_t c = kArrDef[t].cells;
+            for (uint8_t r = 0; r < kNRot; ++r) {
+                out[t * kNRot + r] = c;
+                // clockwise on screen: (x, y) -> (-y, x)
+                for (auto &v : c) {
+                    v = Vec{static_cast<int8_t>(-v.y), v.x};
+                }
+            }
+        }
+        return out;
+    }();
+
+    // Positions tried by a clockwise rotation, relative to the pivot
+    struct Turn {
+        uint8_t n; // number of positions
+        std::array<cells_t, kNKick> cells;
+    };
+
+    static constexpr std::array<Turn, kNState> kArrTurns = [] {
+        std::array<Turn, kNState> out{};
+        for (uint8_t s = 0; s < kNState; ++s) {
+            const Offsets &o = *kArrDef[s / kNRot].offsets;
+            const uint8_t to = next_state(s);
+            out[s].n = o.n;
+            for (uint8_t i = 0; i < o.n; ++i) {
+                const Vec &a = o.at[s % kNRot][i];
+                const Vec &b = o.at[to % kNRot][i];
+                for (uint8_t c = 0; c < NBRK; ++c) {
+                    const Vec &v = kArrCells[to][c];
+                    // offsets are y up
+                    out[s].cells[i][c] = Vec{
+                        static_cast<int8_t>(v.x + a.x - b.x),
+                        static_cast<int8_t>(v.y - a.y + b.y)};
+                }
+            }
+        }
+        return out;
+    }();
+
+    // every rotation keeps the pivot as cell 0, which `place` relies on
+    static_assert(
+        [] {
+            for (const auto &c : kArrCells) {
+                if (c[0].x != 0 || c[0].y != 0)
+                    return false;
+            }
+            return true;
+        }(),
+        "cell 0 of every piece must be its pivot");
+
     // get row ID from index
     static inline constexpr uint8_t row(const uint8_t &idx) {
         return idx / WIDTH;
@@ -142,14 +177,6 @@ namespace {
         return idx + 1;
     }
 
-    // index of the cell which will be occupied when moving up
-    static inline constexpr uint8_t u(const uint8_t &idx) {
-        if (row(idx) == 0 || idx == IDX_NA) {
-            return IDX_NA;
-        }
-        return idx - WIDTH;
-    }
-
     // index of the cell which will be occupied when moving down
     static inline constexpr uint8_t d(const uint8_t &idx) {
         if (row(idx) == HEIGHT - 1 || idx == IDX_NA) {
@@ -158,332 +185,17 @@ namespace {
         return idx + WIDTH;
     }
 
-    static const std::array<brick_t (*)(const brick_t &), kNState>
-        kMapState2FnRotate = {
-            // O0: -> O0 (trivial)
-            [](const brick_t &src) { return src; },
-            // I0: -> I1
-            //
-            // [X][ ]          [X][0]
-            // [0][1][2][3] -> [ ][1][ ][ ]
-            //    [ ][ ][ ]       [2][ ][ ]
-            //    [ ][ ][ ]       [3][ ][ ]
-            [](const brick_t &src) {
-                return brick_t{u(src[1]), src[1], d(src[1]), d(d(src[1]))};
-            },
-            // I1: -> I0
-            //
-            // [X][0]          [X][ ]
-            // [ ][1][ ][ ] -> [0][1][2][3]
-            //    [2][ ][ ]       [ ][ ][ ]
-            //    [3][ ][ ]       [ ][ ][ ]
-            [](const brick_t &src) {
-                return brick_t{l(src[1]), src[1], r(src[1]), r(r(src[1]))};
-            },
-            // T0: -> T1
-            //
-            //    [ ][ ]       [0][ ]
-            // [0][1][2] -> [ ][1][2]
-            // [ ][3][ ]    [ ][3][ ]
-            [](const brick_t &src) {
-                return brick_t{u(src[1]), src[1], src[2], src[3]};
-            },
-            // T1: -> T2
-            //
-            // [ ][0][ ]    [ ][0][ ]
-            // [ ][1][2] -> [1][2][3]
-            //    [3][ ]       [ ][ ]
-            [](const brick_t &src) {
-                return brick_t{src[0], l(src[1]), src[1], src[2]};
-            },
-            // T2: -> T3
-            //
-            // [ ][0][ ]    [ ][0][ ]
-            // [1][2][3] -> [1][2][ ]
-            // [ ][ ]       [ ][3]
-            [](const brick_t &src) {
-                return brick_t{src[0], src[1], src[2], d(src[2])};
-            },
-            // T3: -> T0
-            //
-            // [ ][0]       [ ][ ]
-            // [1][2][ ] -> [0][1][2]
-            // [ ][3][ ]    [ ][3][ ]
-            [](const brick_t &src) {
-                return brick_t{src[1], src[2], r(src[2]), src[3]};
-            },
-            // Z0: -> Z1
-            //
-            //       [ ]          [0]
-            // [0][1][ ] -> [ ][1][2]
-            // [ ][2][3]    [ ][3][ ]
-            [](const brick_t &src) {
-                return brick_t{u(r(src[1])), src[1], r(src[1]), src[2]};
-            },
-            // Z1: -> Z0
-            //
-            //       [0][ ]          [ ][ ]
-            // [ ][1][2][ ] -> [0][1][ ][ ]
-            // [ ][3][ ]       [ ][2][3]
-            [](const brick_t &src) {
-                return brick_t{l(src[1]), src[1], src[3], r(src[3])};
-            },
-            // S0: -> S1
-            //
-            //    [ ]          [0]
-            // [ ][0][1] -> [ ][1][2]
-            // [2][3][ ]    [ ][ ][3]
-            [](const brick_t &src) {
-                return brick_t{u(src[0]), src[0], src[1], r(src[3])};
-            },
-            // S1: -> S0
-            //
-            // [ ][0][ ]
-            // [ ][1][2] -> [ ][0][1]
-            // [ ][ ][3]    [2][3][ ]
-            [](const brick_t &src) {
-                return brick_t{src[1], src[2], l(d(src[1])), d(src[1])};
-            },
-            // L0: -> L1
-            //
-            // [ ][0][ ]    [ ][ ][0]
-            // [ ][1][ ] -> [1][2][3]
-            //    [2][3]       [ ][ ]
-            [](const brick_t &src) {
-                return brick_t{r(src[0]), l(src[1]), src[1], r(src[1])};
-            },
-            // L1: -> L2
-            //
-            // [ ][ ][0]    [0][1][ ]
-            // [1][2][3] -> [ ][2][ ]
-            // [ ][ ]       [ ][3]
-            [](const brick_t &src) {
-                return brick_t{u(src[1]), l(src[0]), src[2], d(src[2])};
-            },
-            // L2: -> L3
-            //
-            // [0][1]       [ ][ ]
-            // [ ][2][ ] -> [0][1][2]
-            // [ ][3][ ]    [3][ ][ ]
-            [](const brick_t &src) {
-                return brick_t{l(src[2]), src[2], r(src[2]), l(src[3])};
-            },
-            // L3: -> L0
-            //
-            //    [ ][ ]       [0][ ]
-            // [0][1][2] -> [ ][1][ ]
-            // [3][ ][ ]    [ ][2][3]
-            [](const brick_t &src) {
-                return brick_t{u(src[1]), src[1], r(src[3]), d(src[2])};
-            },
-            // J0: -> J1
-            //
-            // [ ][0][ ]    [ ][ ][ ]
-            // [ ][1][ ] -> [0][1][2]
-            // [2][3][ ]       [ ][3]
-            [](const brick_t &src) {
-                return brick_t{l(src[1]), src[1], r(src[1]), r(src[3])};
-            },
-            // J1: -> J2
-            //
-            // [ ][ ][ ]    [ ][0][1]
-            // [0][1][2] -> [ ][2][ ]
-            //    [ ][3]       [3][ ]
-            [](const brick_t &src) {
-                return brick_t{u(src[1]), u(src[2]), src[1], l(src[3])};
-            },
-            // J2: -> J3
-            //
-            // [ ][0][1]    [0][ ][ ]
-            // [ ][2][ ] -> [1][2][3]
-            //    [3][ ]       [ ][ ]
-            [](const brick_t &src) {
-                return brick_t{l(src[0]), l(src[2]), src[2], r(src[2])};
-            },
-            // J3: -> J0
-            //
-            // [0][ ][ ]    [ ][0][ ]
-            // [1][2][3] -> [ ][1][ ]
-            //    [ ][ ]    [2][3][ ]
-            [](const brick_t &src) {
-                return brick_t{r(src[0]), src[2], d(src[1]), d(src[2])};
-            },
-    };
-
-    // NOTE: FSM
-    // update rotate coord based on current position and orientation,
-    static inline void update_rot(const brick_t &src, const uint8_t state,
-                                  brick_t &dst) {
-        if (state >= kNState)
-            return;
-        dst = kMapState2FnRotate[state](src);
-    }
-
-    // TODO: currently use placeholder (`src[0]`) when no more than 5 cells
-    // are occupied
-    static const std::array<brick_t (*)(const brick_t &), kNState>
-        kMapState2FnAround = {
-            // O0: -> O0 (trivial)
-            [](const brick_t &src) { return src; },
-            // I0: -> I1
-            //
-            // [ ]             [ ][0]
-            // [0][1][2][3] ->    [1]
-            //       [ ][ ]       [2][ ][ ]
-            //       [ ]          [3][ ]
-            [](const brick_t &src) {
-                return brick_t{u(src[0]), d(src[2]), d(src[3]), d(d(src[2]))};
-            },
-            // I1: -> I0
-            //
-            // [ ][0]          [ ]
-            //    [1]       -> [0][1][2][3]
-            //    [2][ ][ ]          [ ][ ]
-            //    [3][ ]             [ ]
-            [](const brick_t &src) {
-                return brick_t{l(src[0]), r(src[2]), r(r(src[2])), r(src[3])};
-            },
-            // T0: -> T1
-            //
-            //       [ ]       [X][ ]
-            // [0][1][2] ->    [X][X]
-            // [ ][3][ ]    [ ][X][ ]
-            [](const brick_t &src) {
-                return brick_t{u(src[2]), d(src[0]), d(src[2]), src[0]};
-            },
-            // T1: -> T2
-            //
-            // [ ][0][ ]    [ ][X][ ]
-            //    [1][2] -> [X][X][X]
-            //    [3][ ]          [ ]
-            [](const brick_t &src) {
-                return brick_t{l(src[0]), r(src[0]), r(src[3]), src[0]};
-            },
-            // T2: -> T3
-            //
-            // [ ][0][ ]    [ ][X][ ]
-            // [1][2][3] -> [X][X]
-            // [ ]          [ ][X]
-            [](const brick_t &src) {
-                return brick_t{l(src[0]), r(src[0]), d(src[1]), src[0]};
-            },
-            // T3: -> T0
-            //
-            // [ ][0]       [ ]
-            // [1][2]    -> [X][X][X]
-            // [ ][3][ ]    [ ][X][ ]
-            [](const brick_t &src) {
-                return brick_t{l(src[0]), l(src[3]), r(src[3]), src[0]};
-            },
-            // Z0: -> Z1 (anti-clockwise)
-            //
-            //       [ ]          [X]
-            // [0][1][ ] ->    [X][X]
-            // ( )[2][3]    ( )[X]
-            [](const brick_t &src) {
-                return brick_t{d(src[0]), src[0], src[0], src[0]};
-            },
-            // Z1: -> Z0 (clockwise)
-            //
-            //    [3]( )          ( )
-            // [1][2]( ) -> [X][X]( )
-            // [0][ ]       [ ][X][X]
-            [](const brick_t &src) {
-                return brick_t{r(src[3]), r(src[2]), src[0], src[0]};
-            },
-            // S0: -> S1 (anti-clockwise)
-            //
-            //    [ ]( )       [X]
-            //    [0][1] ->    [X][X]
-            // [2][3][ ]          [X]
-            // ( )( )
-            [](const brick_t &src) {
-                return brick_t{u(src[1]), d(src[2]), d(src[3]), src[0]};
-            },
-            // S1: -> S0 (clockwise)
-            //
-            // [0]( )( )
-            // [1][2][ ] ->    [X][X]
-            // [ ][3]       [X][X]
-            [](const brick_t &src) {
-                return brick_t{r(src[0]), r(r(src[0])), src[0], src[0]};
-            },
-            // L0: -> L1
-            //
-            // [ ][0]       [ ]   [0]
-            //    [1]    -> [1][2][3]
-            //    [2][3]
-            [](const brick_t &src) {
-                return brick_t{l(src[0]), src[0], src[0], src[0]};
-            },
-            // L1: -> L2
-            //
-            //       [0]    [0][1]
-            // [0][1][3] ->    [2]
-            // [ ]          [ ][3]
-            [](const brick_t &src) {
-                return brick_t{d(src[0]), src[0], src[0], src[0]};
-            },
-            // L2: -> L3
-            //
-            // [0][1]
-            //    [2]    -> [X][X][X]
-            //    [3][ ]    [X]   [ ]
-            [](const brick_t &src) {
-                return brick_t{r(src[3]), src[0], src[0], src[0]};
-            },
-            // L3: -> L0
-            //
-            //       [ ]    [X][ ]
-            // [0][1][2] -> [X]
-            // [3]          [X][X]
-            [](const brick_t &src) {
-                return brick_t{u(src[2]), src[0], src[0], src[0]};
-            },
-            // J0: -> J1
-            //
-            // ( )[0]       ( )
-            // [ ][1][ ] -> [X][X][X]
-            // [3][2][ ]          [X]
-            [](const brick_t &src) {
-                return brick_t{l(src[0]), src[0], src[0], src[0]};
-            },
-            // J1: -> J2
-            //
-            //    [ ][ ]       [X][X]
-            // [0][1][2] ->    [X]
-            // ( )[ ][3]    ( )[X]
-            [](const brick_t &src) {
-                return brick_t{d(src[0]), src[0], src[0], src[0]};
-            },
-            // J2: -> J3
-            //
-            // [ ][0][1]    [X]
-            // [ ][2][ ] -> [X][X][X]
-            //    [3]( )          ( )
-            [](const brick_t &src) {
-                return brick_t{r(src[3]), src[0], src[0], src[0]};
-            },
-            // J3: -> J0
-            //
-            // [0][ ]( )       [X]( )
-            // [1][2][3] ->    [X]
-            // [ ][ ]       [X][X]
-            [](const brick_t &src) {
-                return brick_t{u(src[3]), src[0], src[0], src[0]};
-            },
-
-    };
-
-    // NOTE: FSM
-    // update indices of cells around the piece which may prevent rotation
-    // (rotated cells are not included)
-    static inline void update_ard(const brick_t &src, const uint8_t state,
-                                  brick_t &dst) {
-
-        if (state >= kNState)
-            return;
-        dst = kMapState2FnAround[state](src);
+    // indices of `cells` placed at `pivot`, `IDX_NA` for cells off the board
+    static inline brick_t place(const cells_t &cells, const uint8_t &pivot) {
+        brick_t out;
+        for (uint8_t i = 0; i < NBRK; ++i) {
+            const int x = col(pivot) + cells[i].x;
+            const int y = row(pivot) + cells[i].y;
+            out[i] = x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT
+                         ? IDX_NA
+                         : static_cast<uint8_t>(y * WIDTH + x);
+        }
+        return out;
     }
 
     // update left coord
@@ -511,36 +223,47 @@ namespace {
 
 // initialize piece context according to the seed
 void core::Piece::Spawn(const uint8_t &seed) {
-    const uint8_t idx = seed % kNStateInit;
-    std::tie(state, cur) = kMapBrickInit.at(idx);
+    const uint8_t type = seed % kNType;
+    const uint8_t s = type * kNRot;
+    Restore(s, place(kArrCells[s], kArrDef[type].spawn));
+}
+
+// restore piece context from a state and position, return false if the
+// position is not one of the state
+bool core::Piece::Restore(const uint8_t &s, const brick_t &c) {
+    if (s >= kNState || c[0] >= TOTAL || place(kArrCells[s], c[0]) != c)
+        return false;
+    state = s;
+    cur = c;
 
     update_left(cur, left);
     update_right(cur, right);
     update_down(cur, down);
-    update_rot(cur, state, rotate);
-    update_ard(cur, state, round);
+    return true;
 }
 
 // Get the shape of the piece according to the seed
 char core::Piece::Shape(const uint8_t &seed) {
-    const uint8_t idx = seed % kNStateInit;
-    return kArrShapeInit.at(idx);
+    return kArrDef[seed % kNType].shape;
 }
 
-void core::Piece::Rotate() {
-    // replace current with rotate
-    cur = rotate;
-    // update state
-    state = next_state(state);
-
-    // rotate go rotate
-    update_rot(cur, state, rotate);
-
-    // update left, right, down and around
-    update_left(cur, left);
-    update_right(cur, right);
-    update_down(cur, down);
-    update_ard(cur, state, round);
+// rotate clockwise to the first free position among the kicks of the
+// current state; return false if none is
+bool core::Piece::Rotate(const field_t &base) {
+    const Turn &t = kArrTurns[state];
+    for (uint8_t i = 0; i < t.n; ++i) {
+        const brick_t dst = place(t.cells[i], cur[0]);
+        if (!core::collide(dst, base)) {
+            state = next_state(state);
+            cur = dst;
+            // update left, right and down
+            update_left(cur, left);
+            update_right(cur, right);
+            update_down(cur, down);
+            return true;
+        }
+    }
+    return false;
 }
 
 void core::Piece::Left() {
@@ -550,10 +273,8 @@ void core::Piece::Left() {
     cur = left;
     // left move left
     update_left(cur, left);
-    // update down, rotate and around
+    // update down
     update_down(cur, down);
-    update_rot(cur, state, rotate);
-    update_ard(cur, state, round);
 }
 
 void core::Piece::Right() {
@@ -563,10 +284,8 @@ void core::Piece::Right() {
     cur = right;
     // right move right
     update_right(cur, right);
-    // update down, rotate and around
+    // update down
     update_down(cur, down);
-    update_rot(cur, state, rotate);
-    update_ard(cur, state, round);
 }
 
 void core::Piece::Down() {
@@ -574,9 +293,7 @@ void core::Piece::Down() {
     cur = down;
     // down move down
     update_down(cur, down);
-    // update left, right, rotate and around
+    // update left and right
     update_left(cur, left);
     update_right(cur, right);
-    update_rot(cur, state, rotate);
-    update_ard(cur, state, round);
 }
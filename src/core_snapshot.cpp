@@ -0,0 +1,104 @@
+#include <algorithm>
+
+#include "core.hpp"
+
+// Snapshot layout (version 2, 48 bytes, multi-byte fields little-endian)
+//
+// | offset | size | field                                                 |
+// |--------|------|-------------------------------------------------------|
+// |      0 |    2 | magic "TS"                                            |
+// |      2 |    1 | version                                               |
+// |      3 |    1 | piece type and rotation (`Piece::state`)              |
+// |      4 |    4 | piece position (`Piece::cur`, pivot first)            |
+// |      8 |    8 | generator state (`Board::rng`)                        |
+// |     16 |    2 | lines cleared (`Board::lines`)                        |
+// |     18 |    1 | next piece seed (`Board::next`)                       |
+// |     19 |    4 | microseconds elapsed since `Board::last_fall`         |
+// |     23 |   25 | base board, 1 bit per cell, row-major, LSB first      |
+//
+// Everything else (`Board::active`, the precomputed moves of `Piece`) is
+// derived on load; the timestamp is stored as an offset so that a snapshot
+// can be resumed in another process.
+namespace {
+    inline constexpr uint8_t kMagic0 = 'T';
+    inline constexpr uint8_t kMagic1 = 'S';
+    inline constexpr uint8_t kVersion = 2;
+
+    inline constexpr uint8_t kOffState = 3;
+    inline constexpr uint8_t kOffCur = 4;
+    inline constexpr uint8_t kOffRng = 8;
+    inline constexpr uint8_t kOffLines = 16;
+    inline constexpr uint8_t kOffNext = 18;
+    inline constexpr uint8_t kOffFall = 19;
+    inline constexpr uint8_t kOffBase = 23;
+
+    static_assert(kOffBase + (TOTAL + 7) / 8 == sizeof(snapshot_t),
+                  "snapshot_t does not match the snapshot layout");
+
+    // write `n` bytes of `v` at `at`, little-endian
+    static inline void put(snapshot_t &out, uint8_t at, uint64_t v,
+                           uint8_t n) {
+        for (uint8_t i = 0; i < n; ++i) {
+            out[at + i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    // read `n` bytes at `at`, little-endian
+    static inline uint64_t get(const snapshot_t &in, uint8_t at, uint8_t n) {
+        uint64_t v = 0;
+        for (uint8_t i = 0; i < n; ++i) {
+            v |= static_cast<uint64_t>(in[at + i]) << (8 * i);
+        }
+        return v;
+    }
+
+} // namespace
+
+// serialize the game into `out`
+void core::save(const core::Piece &p, const core::Board &b, snapshot_t &out) {
+    out.fill(0);
+    out[0] = kMagic0;
+    out[1] = kMagic1;
+    out[2] = kVersion;
+    out[kOffState] = p.state;
+    std::copy(p.cur.begin(), p.cur.end(), out.begin() + kOffCur);
+    put(out, kOffRng, b.rng, 8);
+    put(out, kOffLines, b.lines, 2);
+    out[kOffNext] = b.next;
+
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        steady_clock::now() - b.last_fall)
+                        .count();
+    put(out, kOffFall, std::clamp<int64_t>(us, 0, UINT32_MAX), 4);
+
+    for (uint8_t i = 0; i < TOTAL; ++i) {
+        out[kOffBase + i / 8] |= (b.base[i] != 0) << (i % 8);
+    }
+}
+
+// deserialize the game from `in`, return false (leaving `p` and `b`
+// unspecified) if it is not a valid snapshot
+bool core::load(const snapshot_t &in, core::Piece &p, core::Board &b) {
+    if (in[0] != kMagic0 || in[1] != kMagic1 || in[2] != kVersion)
+        return false;
+
+    field_t base;
+    for (uint8_t i = 0; i < TOTAL; ++i) {
+        base[i] = (in[kOffBase + i / 8] >> (i % 8)) & 1;
+    }
+
+    // the piece must be on the board and clear of the landed blocks
+    brick_t cur;
+    std::copy(in.begin() + kOffCur, in.begin() + kOffCur + NBRK, cur.begin());
+    if (core::collide(cur, base) || !p.Restore(in[kOffState], cur))
+        return false;
+
+    b.rng = get(in, kOffRng, 8);
+    b.lines = static_cast<uint16_t>(get(in, kOffLines, 2));
+    b.next = in[kOffNext];
+    b.last_fall = steady_clock::now() -
+                  std::chrono::microseconds(get(in, kOffFall, 4));
+    b.base = base;
+    b.UpdateActive(p.cur);
+    return true;
+}
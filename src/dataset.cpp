@@ -0,0 +1,665 @@
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+#include "dataset.hpp"
+
+// Chunk layout (multi-byte fields little-endian)
+//
+// | size      | field                                                      |
+// |-----------|------------------------------------------------------------|
+// |         2 | number of states `n`                                       |
+// |     5 x 4 | byte length of each column                                 |
+// |       ... | columns: rows, heights, piece, next, lines                 |
+//
+// Each column is a `n x width` byte matrix, one line per state:
+//
+// | column  | width | line                                               |
+// |---------|-------|----------------------------------------------------|
+// | rows    |    40 | 20 row bitmasks of `base`, 10 bits each (u16)      |
+// | heights |    10 | column heights of `base`                           |
+// | piece   |     5 | `piece`, `cur[0]`, `cur[1..3] - cur[0]`            |
+// | next    |     1 | `next`                                             |
+// | lines   |     2 | `lines` (u16)                                      |
+//
+// Lines are delta coded against the previous state of the chunk (xor for
+// rows, byte-wise difference otherwise), so that consecutive states of a game
+// mostly produce zeros, and the result is run-length coded:
+//
+// - token `0x00-0x7F`: a run of `token + 1` zero bytes
+// - token `0x80-0xFF`: `token - 0x7F` literal bytes follow
+//
+// The coder scans 8 bytes at a time for runs, the rows column is decoded
+// straight into the boards (see `unrle_rows`), and a chunk can be decoded on
+// its own, skipping the columns that are not needed.
+namespace {
+    inline constexpr uint8_t kNCol = 5;
+    inline constexpr uint8_t kChunkHdr = 2 + kNCol * 4;
+    inline constexpr std::array<uint8_t, kNCol> kArrWidth = {
+        HEIGHT * 2, WIDTH, 1 + NBRK, 1, 2};
+    inline constexpr uint8_t kMaxWidth = HEIGHT * 2;
+
+    // longest run or literal of one token
+    inline constexpr uint8_t kMaxRun = 0x80;
+
+    // footer: index offset (8), entries (4), games (4), magic "TD", version
+    inline constexpr uint8_t kFooter = 20;
+    inline constexpr uint8_t kEntry = 16;
+    inline constexpr uint8_t kMagic0 = 'T';
+    inline constexpr uint8_t kMagic1 = 'D';
+    inline constexpr uint8_t kVersion = 1;
+
+    // games recorded by `record` end after this many placements at most
+    inline constexpr uint32_t kMaxPlies = 10000;
+
+    // write `n` bytes of `v`, little-endian
+    static inline void put(char *out, uint64_t v, uint8_t n) {
+        for (uint8_t i = 0; i < n; ++i) {
+            out[i] = static_cast<char>(v >> (8 * i));
+        }
+    }
+
+    // read `n` bytes, little-endian
+    static inline uint64_t get(const char *in, uint8_t n) {
+        uint64_t v = 0;
+        for (uint8_t i = 0; i < n; ++i) {
+            v |= static_cast<uint64_t>(static_cast<uint8_t>(in[i]))
+                 << (8 * i);
+        }
+        return v;
+    }
+
+    // the word tricks below (`zeros`, `mask`) load bytes with `memcpy` and
+    // expect byte `i` in bits `8 * i` to `8 * i + 7`
+    static_assert(std::endian::native == std::endian::little,
+                  "word loads assume a little-endian target");
+
+    // high bit of each byte of a word
+    inline constexpr uint64_t kHigh = 0x8080808080808080ull;
+
+    // high bit of every zero byte among the 8 bytes at `p`
+    static inline uint64_t zeros(const uint8_t *p) {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        return ~(((w & ~kHigh) + ~kHigh) | w) & kHigh;
+    }
+
+    // worst case size of `len` bytes once run-length coded
+    static inline constexpr size_t rle_bound(size_t len) {
+        return len + len / kMaxRun + 1;
+    }
+
+    // run-length code `len` bytes of `p` into `out` (at least
+    // `rle_bound(len)` bytes), return the coded size
+    static inline size_t rle(const uint8_t *p, size_t len, char *out) {
+        char *o = out;
+        size_t i = 0;
+        while (i < len) {
+            const size_t end = std::min(len, i + kMaxRun);
+            size_t j = i;
+            if (p[i] == 0) {
+                // 8 bytes at a time up to the first non-zero byte
+                uint64_t nz = 0;
+                while (j + 8 <= end && !(nz = zeros(p + j) ^ kHigh)) {
+                    j += 8;
+                }
+                if (nz) {
+                    j += std::countr_zero(nz) / 8;
+                } else {
+                    while (j < end && p[j] == 0)
+                        ++j;
+                }
+                *o++ = static_cast<char>(j - i - 1);
+            } else {
+                // a single zero is cheaper as a literal than as a run, stop
+                // at the first two zeros in a row; 7 pairs at a time
+                uint64_t pair = 0;
+                while (j + 8 <= len && j + 7 <= end) {
+                    const uint64_t z = zeros(p + j);
+                    if ((pair = z & (z >> 8)))
+                        break;
+                    j += 7;
+                }
+                if (pair) {
+                    j += std::countr_zero(pair) / 8;
+                } else {
+                    while (j < end &&
+                           (p[j] != 0 || (j + 1 < len && p[j + 1] != 0)))
+                        ++j;
+                }
+                *o++ = static_cast<char>(0x7F + (j - i));
+                std::memcpy(o, p + i, j - i);
+                o += j - i;
+            }
+            i = j;
+        }
+        return static_cast<size_t>(o - out);
+    }
+
+    // decode exactly `want` bytes into `dst` (with `kMaxRun` bytes of slack
+    // past the end), return false if `p` does not hold them
+    static inline bool unrle(const uint8_t *p, size_t len, uint8_t *dst,
+                             size_t want) {
+        size_t o = 0;
+        for (size_t i = 0; i < len;) {
+            const uint8_t t = p[i++];
+            if (t < kMaxRun) {
+                const size_t k = t + 1u;
+                if (o + k > want)
+                    return false;
+                // fixed-size stores, the slack absorbs the overshoot
+                for (size_t q = 0; q < k; q += 16) {
+                    std::memset(dst + o + q, 0, 16);
+                }
+                o += k;
+            } else {
+                const size_t k = t - 0x7Fu;
+                if (i + k > len || o + k > want)
+                    return false;
+                if (k <= 16 && i + 16 <= len) {
+                    std::memcpy(dst + o, p + i, 16);
+                } else {
+                    std::memcpy(dst + o, p + i, k);
+                }
+                i += k;
+                o += k;
+            }
+        }
+        return o == want;
+    }
+
+    // delta code the `n x w` matrix `m` in place, bottom up
+    template <bool Xor>
+    static inline void delta(uint8_t *m, size_t n, size_t w) {
+        for (size_t i = n; i-- > 1;) {
+            uint8_t *cur = m + i * w;
+            const uint8_t *prev = cur - w;
+            for (size_t j = 0; j < w; ++j) {
+                cur[j] = Xor ? cur[j] ^ prev[j] : cur[j] - prev[j];
+            }
+        }
+    }
+
+    // undo the byte-wise difference of `delta`, top down
+    static inline void undelta(uint8_t *m, size_t n, size_t w) {
+        for (size_t i = 1; i < n; ++i) {
+            uint8_t *cur = m + i * w;
+            const uint8_t *prev = cur - w;
+            for (size_t j = 0; j < w; ++j) {
+                cur[j] += prev[j];
+            }
+        }
+    }
+
+    // bitmask of a row of 0 / 1 cells (`Pixel`), cell `x` in bit `x`
+    static inline uint16_t mask(const uint8_t *row) {
+        static_assert(WIDTH >= 8 && WIDTH <= 16, "a row must fit a uint16_t");
+        uint64_t w;
+        std::memcpy(&w, row, sizeof(w));
+        // moves byte `i` to bit `56 + i` without carries
+        uint16_t m = static_cast<uint16_t>((w * 0x0102040810204080ull) >> 56);
+        for (uint8_t x = 8; x < WIDTH; ++x) {
+            m |= static_cast<uint16_t>(row[x] << x);
+        }
+        return m;
+    }
+
+    // write column `c` of `n` states into the matrix `m`
+    static inline void gather(const dataset::State *s, uint16_t n, uint8_t c,
+                              uint8_t *m) {
+        const uint8_t w = kArrWidth[c];
+        for (uint16_t i = 0; i < n; ++i, m += w) {
+            switch (c) {
+            case 0:
+                for (uint8_t r = 0; r < HEIGHT; ++r) {
+                    const uint16_t b = mask(s[i].base.data() + r * WIDTH);
+                    m[2 * r] = static_cast<uint8_t>(b);
+                    m[2 * r + 1] = static_cast<uint8_t>(b >> 8);
+                }
+                break;
+            case 1:
+                std::memcpy(m, s[i].heights.data(), WIDTH);
+                break;
+            case 2:
+                m[0] = s[i].piece;
+                m[1] = s[i].cur[0];
+                for (uint8_t k = 1; k < NBRK; ++k) {
+                    m[1 + k] = s[i].cur[k] - s[i].cur[0];
+                }
+                break;
+            case 3:
+                m[0] = s[i].next;
+                break;
+            case 4:
+                m[0] = static_cast<uint8_t>(s[i].lines);
+                m[1] = static_cast<uint8_t>(s[i].lines >> 8);
+                break;
+            }
+        }
+    }
+
+    // read column `c` (but rows, see `unrle_rows`) of `n` states back from
+    // the matrix `m`
+    static inline void scatter(const uint8_t *m, uint16_t n, uint8_t c,
+                               dataset::State *s) {
+        const uint8_t w = kArrWidth[c];
+        for (uint16_t i = 0; i < n; ++i, m += w) {
+            switch (c) {
+            case 1:
+                std::memcpy(s[i].heights.data(), m, WIDTH);
+                break;
+            case 2:
+                s[i].piece = m[0];
+                s[i].cur[0] = m[1];
+                for (uint8_t k = 1; k < NBRK; ++k) {
+                    s[i].cur[k] = m[1] + m[1 + k];
+                }
+                break;
+            case 3:
+                s[i].next = m[0];
+                break;
+            case 4:
+                s[i].lines = static_cast<uint16_t>(m[0] | m[1] << 8);
+                break;
+            }
+        }
+    }
+
+    // xor the low `k` bits of `b` into the 0 / 1 cells at `cells`
+    static inline void flip(uint8_t *cells, uint8_t b, uint8_t k) {
+        // spreads bit `i` to byte `i`
+        uint64_t v = b * 0x0101010101010101ull & 0x8040201008040201ull;
+        v = ((v + 0x7F7F7F7F7F7F7F7Full) >> 7) & 0x0101010101010101ull;
+        if (k == 8) {
+            uint64_t w;
+            std::memcpy(&w, cells, sizeof(w));
+            w ^= v;
+            std::memcpy(cells, &w, sizeof(w));
+        } else {
+            for (uint8_t x = 0; x < k; ++x) {
+                cells[x] ^= static_cast<uint8_t>(v >> (8 * x));
+            }
+        }
+    }
+
+    // Decode the rows column straight into the boards of `n` states
+    //
+    // Rather than undoing the run-length and delta coding separately, every
+    // board starts as a copy of the previous one and each literal byte flips
+    // the cells of a row that changed; runs of zeros cost nothing.
+    static inline bool unrle_rows(const uint8_t *p, size_t len,
+                                  dataset::State *s, uint16_t n) {
+        const uint8_t w = kArrWidth[0];
+        const size_t want = static_cast<size_t>(n) * w;
+        uint16_t ready = 0; // boards initialized so far
+        auto reach = [&](size_t i) {
+            for (; ready <= i; ++ready) {
+                if (ready == 0) {
+                    s[0].base.fill(0);
+                } else {
+                    s[ready].base = s[ready - 1].base;
+                }
+            }
+        };
+
+        size_t o = 0;
+        for (size_t i = 0; i < len;) {
+            const uint8_t t = p[i++];
+            if (t < kMaxRun) {
+                o += t + 1u;
+                if (o > want)
+                    return false;
+                continue;
+            }
+            size_t k = t - 0x7Fu;
+            if (i + k > len || o + k > want)
+                return false;
+            for (; k > 0; --k, ++i, ++o) {
+                const size_t at = o % w;
+                reach(o / w);
+                // even bytes hold cells 0-7 of a row, odd bytes the rest
+                uint8_t *row = s[o / w].base.data() + at / 2 * WIDTH;
+                if (at % 2 == 0) {
+                    flip(row, p[i], 8);
+                } else {
+                    flip(row + 8, p[i], WIDTH - 8);
+                }
+            }
+        }
+        if (o != want)
+            return false;
+        if (n > 0)
+            reach(n - 1);
+        return true;
+    }
+
+    // scratch matrix of one column of a chunk
+    static thread_local std::array<uint8_t,
+                                   dataset::kChunk * kMaxWidth + kMaxRun>
+        scratch;
+
+} // namespace
+
+// fill `s` from a game
+void dataset::capture(const core::Piece &p, const core::Board &b, State &s) {
+    s.base = b.base;
+    s.cur = p.cur;
+    for (uint8_t x = 0; x < WIDTH; ++x) {
+        uint8_t r = 0;
+        while (r < HEIGHT && b.base[r * WIDTH + x] == 0)
+            ++r;
+        s.heights[x] = HEIGHT - r;
+    }
+    s.lines = b.lines;
+    s.piece = p.state;
+    s.next = b.next;
+}
+
+// restore a game from `s`; the generator state is not recorded, so `b.rng`
+// is left as is
+bool dataset::restore(const State &s, core::Piece &p, core::Board &b) {
+    // the piece must be on the board and clear of the landed blocks, as in
+    // `core::load`
+    if (core::collide(s.cur, s.base) || !p.Restore(s.piece, s.cur))
+        return false;
+    b.base = s.base;
+    b.lines = s.lines;
+    b.next = s.next;
+    b.UpdateActive(p.cur);
+    return true;
+}
+
+void dataset::encode(const State *states, uint16_t n, std::string &out) {
+    const size_t hdr = out.size();
+    out.resize(hdr + kChunkHdr);
+    put(out.data() + hdr, n, 2);
+    for (uint8_t c = 0; c < kNCol; ++c) {
+        const uint8_t w = kArrWidth[c];
+        gather(states, n, c, scratch.data());
+        if (c == 0) {
+            delta<true>(scratch.data(), n, w);
+        } else {
+            delta<false>(scratch.data(), n, w);
+        }
+        const size_t len = static_cast<size_t>(n) * w;
+        const size_t start = out.size();
+        out.resize(start + rle_bound(len));
+        const size_t coded = rle(scratch.data(), len, out.data() + start);
+        out.resize(start + coded);
+        put(out.data() + hdr + 2 + c * 4, coded, 4);
+    }
+}
+
+size_t dataset::decode(std::string_view buf, std::vector<State> &out,
+                       uint8_t columns) {
+    if (buf.size() < kChunkHdr)
+        return 0;
+    const uint16_t n = static_cast<uint16_t>(get(buf.data(), 2));
+    if (n > kChunk)
+        return 0;
+    out.resize(n);
+
+    size_t pos = kChunkHdr;
+    for (uint8_t c = 0; c < kNCol; ++c) {
+        const size_t len = get(buf.data() + 2 + c * 4, 4);
+        if (len > buf.size() - pos)
+            return 0;
+        const auto *col = reinterpret_cast<const uint8_t *>(buf.data() + pos);
+        if (c == 0 && (columns & kColRows)) {
+            if (!unrle_rows(col, len, out.data(), n))
+                return 0;
+        } else if (columns & (1 << c)) {
+            const uint8_t w = kArrWidth[c];
+            if (!unrle(col, len, scratch.data(), static_cast<size_t>(n) * w))
+                return 0;
+            undelta(scratch.data(), n, w);
+            scatter(scratch.data(), n, c, out.data());
+        }
+        pos += len;
+    }
+    return pos;
+}
+
+// append a state to the current game
+void dataset::Writer::Add(const State &s) {
+    pending.push_back(s);
+    ++ply;
+    if (pending.size() == kChunk) {
+        index.push_back(Entry{game, static_cast<uint32_t>(ply - kChunk),
+                              out.size()});
+        encode(pending.data(), kChunk, out);
+        pending.clear();
+    }
+}
+
+// end the current game
+void dataset::Writer::Next() {
+    if (!pending.empty()) {
+        const auto n = static_cast<uint16_t>(pending.size());
+        index.push_back(Entry{game, ply - n, out.size()});
+        encode(pending.data(), n, out);
+        pending.clear();
+    }
+    ++game;
+    ply = 0;
+}
+
+// end the dataset
+void dataset::Writer::Finish() {
+    if (ply > 0)
+        Next();
+    const uint64_t at = out.size();
+    char e[kEntry];
+    for (const auto &i : index) {
+        put(e, i.game, 4);
+        put(e + 4, i.ply, 4);
+        put(e + 8, i.offset, 8);
+        out.append(e, kEntry);
+    }
+    char f[kFooter];
+    put(f, at, 8);
+    put(f + 8, index.size(), 4);
+    put(f + 12, game, 4);
+    f[16] = kMagic0;
+    f[17] = kMagic1;
+    f[18] = kVersion;
+    f[19] = 0;
+    out.append(f, kFooter);
+}
+
+// parse the footer and index
+bool dataset::Reader::Open(std::string_view d) {
+    data = d;
+    index.clear();
+    cached = SIZE_MAX;
+    if (d.size() < kFooter)
+        return false;
+    const char *f = d.data() + d.size() - kFooter;
+    if (f[16] != kMagic0 || f[17] != kMagic1 || f[18] != kVersion)
+        return false;
+    const uint64_t at = get(f, 8);
+    const uint64_t n = get(f + 8, 4);
+    const uint32_t games = static_cast<uint32_t>(get(f + 12, 4));
+    // the index fills the space between the chunks and the footer exactly
+    if (at > d.size() - kFooter || (d.size() - kFooter - at) % kEntry != 0 ||
+        (d.size() - kFooter - at) / kEntry != n)
+        return false;
+
+    index.resize(n);
+    for (uint64_t i = 0; i < n; ++i) {
+        const char *e = d.data() + at + i * kEntry;
+        index[i] = Entry{static_cast<uint32_t>(get(e, 4)),
+                         static_cast<uint32_t>(get(e + 4, 4)), get(e + 8, 8)};
+        if (index[i].offset >= at || index[i].game >= games)
+            return false;
+    }
+    // games without any ply have no entry, keep their count in a sentinel
+    index.push_back(Entry{games, 0, at});
+    return true;
+}
+
+uint32_t dataset::Reader::Games() const {
+    return index.empty() ? 0 : index.back().game;
+}
+
+uint32_t dataset::Reader::Plies(uint32_t game) const {
+    auto it = std::upper_bound(index.begin(), index.end(), game,
+                               [](uint32_t g, const Entry &e) {
+                                   return g < e.game;
+                               });
+    if (it == index.begin() || (--it)->game != game)
+        return 0;
+    return it->ply + static_cast<uint32_t>(get(data.data() + it->offset, 2));
+}
+
+// decode ply `ply` of game `game`
+bool dataset::Reader::Get(uint32_t game, uint32_t ply, State &s,
+                          uint8_t cols) {
+    auto it = std::upper_bound(
+        index.begin(), index.end(), std::make_pair(game, ply),
+        [](const std::pair<uint32_t, uint32_t> &k, const Entry &e) {
+            return k.first < e.game || (k.first == e.game && k.second < e.ply);
+        });
+    if (it == index.begin() || (--it)->game != game ||
+        it + 1 == index.end())
+        return false;
+
+    const size_t i = static_cast<size_t>(it - index.begin());
+    if (cached != i || (cols & ~columns)) {
+        cached = SIZE_MAX;
+        if (decode(data.substr(it->offset, (it + 1)->offset - it->offset),
+                   chunk, cols) == 0)
+            return false;
+        cached = i;
+        columns = cols;
+    }
+    if (ply - it->ply >= chunk.size())
+        return false;
+    s = chunk[ply - it->ply];
+    return true;
+}
+
+int dataset::record(const char *path, uint32_t games, uint64_t seed) {
+    // random placements: a rotation, a shift, then a drop
+    std::vector<State> states;
+    std::vector<uint32_t> plies;
+    std::mt19937_64 policy(seed);
+    for (uint32_t g = 0; g < games; ++g) {
+        core::Board b(seed + g);
+        core::Piece p;
+        p.Spawn(b.Pop());
+        uint32_t n = 0;
+        bool over = false;
+        while (!over && n < kMaxPlies) {
+            State s;
+            capture(p, b, s);
+            states.push_back(s);
+            ++n;
+            for (uint64_t r = policy() % 4; r > 0; --r) {
+                core::input('k', p, b);
+            }
+            const int shift = static_cast<int>(policy() % WIDTH) - WIDTH / 2;
+            for (int i = 0; i < std::abs(shift); ++i) {
+                core::input(shift < 0 ? 'h' : 'l', p, b);
+            }
+            while (!core::collide(p.down, b.base)) {
+                p.Down();
+            }
+            over = core::land(p, b);
+        }
+        plies.push_back(n);
+    }
+
+    using sec_f = std::chrono::duration<double>;
+    const double raw = static_cast<double>(states.size() * sizeof(field_t));
+
+    const time_point t0 = steady_clock::now();
+    Writer w;
+    size_t k = 0;
+    for (uint32_t n : plies) {
+        for (uint32_t i = 0; i < n; ++i) {
+            w.Add(states[k++]);
+        }
+        w.Next();
+    }
+    w.Finish();
+    const time_point t1 = steady_clock::now();
+
+    // decode every chunk in a row, as a training loader would
+    Reader r;
+    bool ok = r.Open(w.out) && r.Games() == games;
+    std::vector<State> chunk;
+    for (size_t i = 0; ok && i + 1 < r.index.size(); ++i) {
+        ok = decode(std::string_view(w.out).substr(r.index[i].offset), chunk);
+    }
+    const time_point t2 = steady_clock::now();
+
+    // random access to every ply, which also checks the encoding
+    State s;
+    k = 0;
+    for (uint32_t g = 0; ok && g < games; ++g) {
+        for (uint32_t i = 0; ok && i < plies[g]; ++i, ++k) {
+            ok = r.Get(g, i, s) && s.base == states[k].base &&
+                 s.cur == states[k].cur && s.heights == states[k].heights &&
+                 s.piece == states[k].piece && s.next == states[k].next &&
+                 s.lines == states[k].lines;
+        }
+    }
+    if (!ok) {
+        std::cerr << "Dataset does not decode back" << std::endl;
+        return 1;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(w.out.data(), static_cast<std::streamsize>(w.out.size()))) {
+        std::cerr << "Failed to write dataset: " << path << std::endl;
+        return 1;
+    }
+    // throughput in `field_t` bytes, the size of the naive dump
+    std::fprintf(stderr,
+                 "games=%u states=%zu bytes=%zu bytes/state=%.2f "
+                 "encode=%.0fMB/s decode=%.0fMB/s\n",
+                 games, states.size(), w.out.size(),
+                 static_cast<double>(w.out.size()) /
+                     static_cast<double>(std::max<size_t>(states.size(), 1)),
+                 raw / 1e6 / sec_f(t1 - t0).count(),
+                 raw / 1e6 / sec_f(t2 - t1).count());
+    return 0;
+}
+
+int dataset::replay(const char *path, uint32_t game, uint32_t ply) {
+    std::ifstream in(path, std::ios::binary);
+    const std::string data(std::istreambuf_iterator<char>(in), {});
+    Reader r;
+    State s;
+    core::Piece p;
+    core::Board b;
+    if (!r.Open(data)) {
+        std::cerr << "Invalid dataset: " << path << std::endl;
+        return 1;
+    }
+    if (!r.Get(game, ply, s) || !restore(s, p, b)) {
+        std::cerr << "No ply " << ply << " in game " << game << " ("
+                  << r.Games() << " games, " << r.Plies(game) << " plies)"
+                  << std::endl;
+        return 1;
+    }
+
+    std::array<std::string, HEIGHT> screen;
+    core::ToString(b.active, screen);
+    for (const auto &row : screen) {
+        std::cout << "|" << row << "|\n";
+    }
+    std::cout << "lines=" << s.lines << " next=" << p.Shape(s.next)
+              << " heights=";
+    for (uint8_t h : s.heights) {
+        std::cout << static_cast<int>(h) << ' ';
+    }
+    std::cout << std::endl;
+    return 0;
+}
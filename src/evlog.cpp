@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "evlog.hpp"
+
+// File layout: an 8-byte header (magic "TEVL", version, record size, both
+// u16 little-endian), then `Record`s as they are in memory (little-endian),
+// in the order the writer collected them: ordered within a session, not
+// across sessions.
+//
+// Games push their events into their own `Stream`; the writer thread wakes
+// up every `kFlushPeriod` (or when `close` is called), drains every stream
+// into a batch and writes it with one `write` call per `kBatch` records, so
+// the game threads never wait for the disk and the file only sees large
+// sequential appends. Once the file would grow past `kRotateBytes`, it is
+// renamed to `<path>.1` (shifting older ones up to `<path>.<kKeep>`) and a
+// new one is started.
+namespace {
+    inline constexpr char kMagic[4] = {'T', 'E', 'V', 'L'};
+    inline constexpr uint16_t kVersion = 1;
+    inline constexpr uint8_t kHeader = 8;
+    // records per write, 64 KiB
+    inline constexpr size_t kBatch = 4096;
+    inline constexpr uint64_t kRotateBytes = 64ull << 20;
+    // rotated files kept
+    inline constexpr uint8_t kKeep = 4;
+    inline constexpr std::chrono::milliseconds kFlushPeriod(50);
+
+    inline constexpr std::array<const char *, evlog::kNKind> kArrKindName = {
+        "spawn", "move", "rotate", "land", "clear", "over"};
+
+    struct Writer {
+        std::string path;
+        int fd = -1;
+        uint64_t size = 0; // bytes in the current file
+        std::thread th;
+
+        // guarded by `mu`
+        std::mutex mu;
+        std::condition_variable cv;
+        std::vector<evlog::Stream *> streams;
+        bool stop = false;
+
+        // owned by the writer thread
+        std::vector<evlog::Record> batch;
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        uint64_t writes = 0;
+        uint64_t dropped = 0;
+        uint32_t files = 0;
+    };
+
+    static Writer *writer = nullptr;
+
+    static inline bool write_all(int fd, const char *p, size_t n) {
+        while (n > 0) {
+            const ssize_t k = write(fd, p, n);
+            if (k < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            p += k;
+            n -= static_cast<size_t>(k);
+        }
+        return true;
+    }
+
+    // move the current file (if any) out of the way and start a new one
+    static bool rotate(Writer &w) {
+        if (w.fd >= 0) {
+            ::close(w.fd);
+            w.fd = -1;
+        }
+        if (access(w.path.c_str(), F_OK) == 0) {
+            for (uint8_t i = kKeep; i > 1; --i) {
+                std::rename((w.path + "." + std::to_string(i - 1)).c_str(),
+                            (w.path + "." + std::to_string(i)).c_str());
+            }
+            std::rename(w.path.c_str(), (w.path + ".1").c_str());
+        }
+        w.fd = ::open(w.path.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                      0644);
+        if (w.fd < 0)
+            return false;
+        char hdr[kHeader];
+        std::memcpy(hdr, kMagic, sizeof(kMagic));
+        hdr[4] = static_cast<char>(kVersion & 0xFF);
+        hdr[5] = static_cast<char>(kVersion >> 8);
+        hdr[6] = static_cast<char>(sizeof(evlog::Record));
+        hdr[7] = 0;
+        w.size = kHeader;
+        ++w.files;
+        return write_all(w.fd, hdr, kHeader);
+    }
+
+    // write the batch out, rotating first if it does not fit the file
+    static void flush(Writer &w) {
+        if (w.batch.empty())
+            return;
+        const size_t n = w.batch.size() * sizeof(evlog::Record);
+        if (w.size + n > kRotateBytes && !rotate(w)) {
+            std::perror(w.path.c_str());
+        }
+        if (w.fd >= 0 &&
+            write_all(w.fd, reinterpret_cast<const char *>(w.batch.data()),
+                      n)) {
+            w.size += n;
+            w.bytes += n;
+            w.records += w.batch.size();
+            ++w.writes;
+        }
+        w.batch.clear();
+    }
+
+    static void run(Writer &w) {
+        std::vector<evlog::Stream *> live;
+        std::vector<evlog::Stream *> done;
+        bool stop = false;
+        while (!stop) {
+            {
+                std::unique_lock<std::mutex> lock(w.mu);
+                w.cv.wait_for(lock, kFlushPeriod, [&] { return w.stop; });
+                stop = w.stop;
+                live = w.streams;
+            }
+
+            for (evlog::Stream *s : live) {
+                // read before draining: everything pushed before `detach`
+                // is then in the ring
+                const bool closed = s->closed.load(std::memory_order_acquire);
+                evlog::Record r;
+                while (s->ring.Pop(r)) {
+                    w.batch.push_back(r);
+                    if (w.batch.size() == kBatch)
+                        flush(w);
+                }
+                if (closed || stop)
+                    done.push_back(s);
+            }
+            flush(w);
+
+            if (done.empty())
+                continue;
+            {
+                std::lock_guard<std::mutex> lock(w.mu);
+                for (evlog::Stream *s : done) {
+                    w.streams.erase(
+                        std::find(w.streams.begin(), w.streams.end(), s));
+                }
+            }
+            for (evlog::Stream *s : done) {
+                w.dropped += s->dropped.load(std::memory_order_relaxed);
+                delete s;
+            }
+            done.clear();
+        }
+    }
+
+} // namespace
+
+bool evlog::open(const char *path) {
+    if (writer != nullptr)
+        return false;
+    auto *w = new Writer();
+    w->path = path;
+    if (!rotate(*w)) {
+        std::perror(path);
+        delete w;
+        return false;
+    }
+    w->batch.reserve(kBatch);
+    w->th = std::thread(run, std::ref(*w));
+    writer = w;
+    return true;
+}
+
+evlog::Stream *evlog::attach(uint32_t session) {
+    if (writer == nullptr)
+        return nullptr;
+    auto *s = new Stream();
+    s->session = session;
+    std::lock_guard<std::mutex> lock(writer->mu);
+    writer->streams.push_back(s);
+    return s;
+}
+
+void evlog::detach(Stream *s) {
+    if (s != nullptr)
+        s->closed.store(true, std::memory_order_release);
+}
+
+// print the writer stats to stderr
+void evlog::close() {
+    if (writer == nullptr)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(writer->mu);
+        writer->stop = true;
+    }
+    writer->cv.notify_one();
+    writer->th.join();
+    if (writer->fd >= 0)
+        ::close(writer->fd);
+    std::fprintf(stderr,
+                 "events: records=%lu bytes=%lu writes=%lu files=%u "
+                 "dropped=%lu\n",
+                 static_cast<unsigned long>(writer->records),
+                 static_cast<unsigned long>(writer->bytes),
+                 static_cast<unsigned long>(writer->writes), writer->files,
+                 static_cast<unsigned long>(writer->dropped));
+    delete writer;
+    writer = nullptr;
+}
+
+int evlog::dump(const char *path) {
+    std::ifstream in(path, std::ios::binary);
+    const std::string data(std::istreambuf_iterator<char>(in), {});
+    const auto *u = reinterpret_cast<const uint8_t *>(data.data());
+    if (data.size() < kHeader ||
+        std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0 ||
+        (u[4] | u[5] << 8) != kVersion || u[6] != sizeof(Record) ||
+        (data.size() - kHeader) % sizeof(Record) != 0) {
+        std::cerr << "Invalid event log: " << path << std::endl;
+        return 1;
+    }
+
+    // one line per event: seconds since the first event, session, kind,
+    // then the piece (shape, rotation and pivot row/column)
+    const size_t n = (data.size() - kHeader) / sizeof(Record);
+    core::Piece p;
+    uint64_t t0 = 0;
+    for (size_t i = 0; i < n; ++i) {
+        Record r;
+        std::memcpy(&r, data.data() + kHeader + i * sizeof(Record), sizeof(r));
+        const uint8_t k = static_cast<uint8_t>(r.kind);
+        if (i == 0)
+            t0 = r.t;
+        std::printf("%12.6f %8u %-6s %c/%u %2u,%u",
+                    static_cast<double>(static_cast<int64_t>(r.t - t0)) / 1e9,
+                    r.session, k < kNKind ? kArrKindName[k] : "?",
+                    p.Shape(r.piece / core::kNRot), r.piece % core::kNRot,
+                    r.cell / WIDTH, r.cell % WIDTH);
+        if (r.kind == Kind::Move) {
+            std::printf(" %c", r.arg);
+        } else if (r.kind == Kind::Clear) {
+            std::printf(" %u", r.arg);
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
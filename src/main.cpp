@@ -1,20 +1,35 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "ai.hpp"
+#include "bench.hpp"
 #include "core.hpp"
+#include "dataset.hpp"
+#include "evlog.hpp"
+#include "metrics.hpp"
+#include "net.hpp"
 #include "term.hpp"
+#include "timing.hpp"
 
-void handle_key(char key, core::Piece &p, const core::Board &b, bool &over) {
-    if (key == 'h' && !core::collide(p.left, b.base)) {
-        p.Left();
-    } else if (key == 'l' && !core::collide(p.right, b.base)) {
-        p.Right();
-    } else if (key == 'k' && !core::collide(p.rotate, b.base) &&
-               !core::collide(p.round, b.base)) {
-        p.Rotate();
-    } else if (key == 'j' && !core::collide(p.down, b.base)) {
-        p.Down();
-    } else if (key == 'p') { // pause by pressing 'p'
-        term::pause(key);
-    } else if (key == 'q') { // quit by pressing 'q'
+// `paused` holds the time the game was paused, or the epoch while it runs
+void handle_key(const term::KeyEvent &ev, core::Piece &p, core::Board &b,
+                timing::Engine &e, time_point &paused, bool &over) {
+    if (ev.key == 'p') { // pause by pressing 'p'
+        if (paused == time_point{}) {
+            paused = ev.t;
+        } else {
+            // the game did not go on while paused
+            e.Delay(ev.t - paused, b);
+            paused = time_point{};
+        }
+    } else if (ev.key == 'q') { // quit by pressing 'q'
         over = true;
+    } else if (paused == time_point{}) {
+        // movement keys are shared with the server (see `net::serve`)
+        e.Key(ev.key, ev.t, p, b);
     }
     // // avoid otherwise beep
     // else {
@@ -22,38 +37,193 @@ void handle_key(char key, core::Piece &p, const core::Board &b, bool &over) {
     // }
 }
 
-int main() {
+// start the event log if `TTETRIS_EVENTS` names one, return false if it
+// cannot be opened
+static bool log_events() {
+    const char *path = std::getenv("TTETRIS_EVENTS");
+    return path == nullptr || *path == '\0' || evlog::open(path);
+}
+
+// serve the metrics if `TTETRIS_METRICS` names a port or a socket, return
+// false if it cannot be set up
+static bool serve_metrics() {
+    const char *where = std::getenv("TTETRIS_METRICS");
+    return where == nullptr || *where == '\0' || metrics::serve(where);
+}
+
+int main(int argc, char *argv[]) {
+    // `ttetris resume <snapshot>` / `ttetris serve <socket>` /
+    // `ttetris connect <socket>` / `ttetris watch <socket> <session>` /
+    // `ttetris record <dataset> <games> <seed>` /
+    // `ttetris replay <dataset> <game> <ply>` /
+    // `ttetris bench [<baseline> [save]]` / `ttetris events <log>` /
+    // `ttetris surface <table>` / `ttetris autoplay <table> <games> <seed>`
+    //
+    // `TTETRIS_EVENTS=<log>` logs the game events of the local game or of
+    // every session of the server (see `evlog.hpp`), and
+    // `TTETRIS_METRICS=<port|socket>` serves their metrics (see
+    // `metrics.hpp`).
+    const char *snap = nullptr;
+    if (argc == 3 && std::strcmp(argv[1], "resume") == 0) {
+        snap = argv[2];
+    } else if (argc == 3 && std::strcmp(argv[1], "serve") == 0) {
+        if (!log_events() || !serve_metrics())
+            return 1;
+        // the sessions have detached from the event log once it returns
+        const int rc = net::serve(argv[2]);
+        evlog::close();
+        return rc;
+    } else if (argc == 3 && std::strcmp(argv[1], "connect") == 0) {
+        return net::play(argv[2]);
+    } else if (argc == 4 && std::strcmp(argv[1], "watch") == 0) {
+        return net::watch(argv[2], std::strtoul(argv[3], nullptr, 10));
+    } else if (argc == 5 && std::strcmp(argv[1], "record") == 0) {
+        return dataset::record(argv[2], std::strtoul(argv[3], nullptr, 10),
+                               std::strtoull(argv[4], nullptr, 10));
+    } else if (argc == 5 && std::strcmp(argv[1], "replay") == 0) {
+        return dataset::replay(argv[2], std::strtoul(argv[3], nullptr, 10),
+                               std::strtoul(argv[4], nullptr, 10));
+    } else if (argc >= 2 && argc <= 4 && std::strcmp(argv[1], "bench") == 0 &&
+               (argc < 4 || std::strcmp(argv[3], "save") == 0)) {
+        return bench::run(argc > 2 ? argv[2] : nullptr, argc == 4);
+    } else if (argc == 3 && std::strcmp(argv[1], "events") == 0) {
+        return evlog::dump(argv[2]);
+    } else if (argc == 3 && std::strcmp(argv[1], "surface") == 0) {
+        return ai::generate(argv[2]);
+    } else if (argc == 5 && std::strcmp(argv[1], "autoplay") == 0) {
+        return ai::autoplay(argv[2], std::strtoul(argv[3], nullptr, 10),
+                            std::strtoull(argv[4], nullptr, 10));
+    } else if (argc != 1) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [resume <snapshot>|serve <socket>|connect <socket>|"
+                     "watch <socket> <session>|"
+                     "record <dataset> <games> <seed>|"
+                     "replay <dataset> <game> <ply>|"
+                     "bench [<baseline> [save]]|events <log>|"
+                     "surface <table>|autoplay <table> <games> <seed>]"
+                  << std::endl;
+        return 1;
+    }
+
+    core::Board b = core::Board();
+    core::Piece p;
+    p.Spawn(b.Pop());
+
+    // resume from the snapshot if there is one
+    snapshot_t data;
+    if (snap != nullptr) {
+        std::ifstream in(snap, std::ios::binary);
+        if (in && !(in.read(reinterpret_cast<char *>(data.data()),
+                            data.size()) &&
+                    core::load(data, p, b))) {
+            std::cerr << "Invalid snapshot: " << snap << std::endl;
+            return 1;
+        }
+    }
+
+    if (!log_events() || !serve_metrics())
+        return 1;
+
     // Enable raw mode
     term::Termios orig_termios;
     term::enableRawMode(orig_termios);
 
     // Initialize the board
     bool game_over = false;
+    bool lost = false;
     std::array<std::string, HEIGHT> screen;
-    char key;
+    std::string frame;
+    term::Output out;
+    term::Input in;
+    term::KeyEvent ev;
+    time_point paused{};
+    time_point ran{}; // latest time the engine was run to
 
-    core::Board b = core::Board();
-    core::Piece p;
-    p.Spawn(b.Pop());
+    timing::Engine eng;
+    eng.log = evlog::attach(0);
+    eng.Start(p, b);
+    metrics::add(metrics::Gauge::Sessions, 1);
+    in.Start();
 
-    while (!game_over) {
-        game_over = core::step(p, b);
+    bool dirty = true;
+    while (true) {
+        if (dirty) {
+            // update the active board
+            const time_point t0 = steady_clock::now();
+            b.UpdateActive(p.cur);
+            core::ToString(b.active, screen);
 
-        if (read(STDIN_FILENO, &key, 1) > 0) {
-            handle_key(key, p, b, game_over);
+            // clear the screen and print the current state; a frame the
+            // terminal cannot take yet is dropped in favor of the next one
+            term::clearScreen(frame);
+            term::printScreen(screen, p.Shape(b.next), b.lines, game_over,
+                              frame);
+            // `Present` takes the frame and writes it, count it before
+            const uint64_t built = static_cast<uint64_t>(
+                timing::nsec(steady_clock::now() - t0).count());
+            metrics::add(metrics::Counter::Frames);
+            metrics::add(metrics::Counter::Bytes, frame.size());
+            metrics::observe(metrics::Histogram::FrameTime, built);
+            out.Present(frame);
+            dirty = false;
         }
 
-        // update the active board
-        b.UpdateActive(p.cur);
-        core::ToString(b.active, screen);
+        if (game_over)
+            break;
 
-        // clear the screen and print the current state
-        term::clearScreen();
-        term::printScreen(screen, p.Shape(b.next), b.lines, game_over);
-
-        usleep(10000); // ~100 FPS
+        // sleep until a key arrives, the next deadline is due or the
+        // terminal can take more output
+        const time_point until =
+            paused == time_point{} ? eng.Next() : time_point::max();
+        const bool key_ready =
+            timing::wait(in.fd, until, out.Pending() ? out.fd : -1);
+        out.Flush();
+        if (key_ready) {
+            in.Ack();
+            metrics::observe(metrics::Histogram::InputDepth, in.ring.Size());
+            while (!game_over && in.Pop(ev)) {
+                // fire the deadlines due before the key arrived, then apply
+                // it; a key that arrived before deadlines already fired is
+                // applied after them, time never goes back
+                ev.t = std::max(ev.t, ran);
+                if (paused == time_point{}) {
+                    ran = ev.t;
+                    game_over = lost = eng.Run(ran, p, b);
+                }
+                if (!game_over)
+                    handle_key(ev, p, b, eng, paused, game_over);
+            }
+            dirty = true;
+        }
+        if (!game_over && paused == time_point{} &&
+            eng.Next() <= steady_clock::now()) {
+            ran = steady_clock::now();
+            game_over = lost = eng.Run(ran, p, b);
+            dirty = true;
+        }
     }
 
+    metrics::add(metrics::Gauge::Sessions, -1);
+    in.Stop();
+    out.Drain();
     term::disableRawMode(orig_termios);
+    eng.jitter.Report("timing");
+    in.Report("input");
+    out.Report("output");
+    evlog::detach(eng.log);
+    evlog::close();
+
+    // suspend the game into the snapshot, or drop it once the game is lost
+    if (snap != nullptr && lost) {
+        std::remove(snap);
+    } else if (snap != nullptr) {
+        core::save(p, b, data);
+        std::ofstream file(snap, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char *>(data.data()),
+                       data.size())) {
+            std::cerr << "Failed to save snapshot: " << snap << std::endl;
+            return 1;
+        }
+    }
     return 0;
 }
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "metrics.hpp"
+
+// Counting only touches the slot of the calling thread; the set of slots is
+// only locked to register a new thread and to scrape. A scrape reads the
+// slots while their threads go on counting, so the values of one response
+// are not a consistent snapshot, but each of them is a valid recent value.
+namespace {
+    struct Desc {
+        const char *name;
+        const char *help;
+    };
+
+    inline constexpr std::array<Desc, metrics::kNCounter> kArrCounter = {{
+        {"ttetris_ticks_total",
+         "Game deadlines fired (gravity, lock delay, auto-shift)."},
+        {"ttetris_frames_total", "Frames rendered."},
+        {"ttetris_rendered_bytes_total", "Bytes of rendered frames."},
+        {"ttetris_lines_cleared_total", "Lines cleared."},
+        {"ttetris_games_started_total", "Games started or resumed."},
+        {"ttetris_games_over_total", "Games lost."},
+    }};
+
+    inline constexpr std::array<Desc, metrics::kNGauge> kArrGauge = {{
+        {"ttetris_sessions", "Games being played."},
+    }};
+
+    // histograms: first bucket bound and its unit in the output
+    struct HistDesc {
+        Desc d;
+        uint64_t base;
+        double unit;
+    };
+    inline constexpr std::array<HistDesc, metrics::kNHistogram>
+        kArrHistogram = {{
+            {{"ttetris_frame_seconds", "Time to build a frame."}, 250, 1e9},
+            {{"ttetris_input_depth", "Keys waiting when the game took them."},
+             1,
+             1},
+        }};
+
+    // registered slots, never freed: the counts of a thread outlive it
+    static std::mutex mu;
+    static std::vector<metrics::Slot *> slots;
+
+    static inline void header(std::string &out, const Desc &d,
+                              const char *type) {
+        out += "# HELP ";
+        out += d.name;
+        out += ' ';
+        out += d.help;
+        out += "\n# TYPE ";
+        out += d.name;
+        out += ' ';
+        out += type;
+        out += '\n';
+    }
+
+    // current values in the text exposition format
+    static void render(std::string &out) {
+        std::array<uint64_t, metrics::kNCounter> counters{};
+        std::array<int64_t, metrics::kNGauge> gauges{};
+        std::array<std::array<uint64_t, metrics::kNBucket>,
+                   metrics::kNHistogram>
+            buckets{};
+        std::array<uint64_t, metrics::kNHistogram> sums{};
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            for (const metrics::Slot *s : slots) {
+                for (uint8_t i = 0; i < metrics::kNCounter; ++i) {
+                    counters[i] +=
+                        s->counters[i].load(std::memory_order_relaxed);
+                }
+                for (uint8_t i = 0; i < metrics::kNGauge; ++i) {
+                    gauges[i] += s->gauges[i].load(std::memory_order_relaxed);
+                }
+                for (uint8_t h = 0; h < metrics::kNHistogram; ++h) {
+                    const auto &b = s->histograms[h];
+                    for (uint8_t i = 0; i < metrics::kNBucket; ++i) {
+                        buckets[h][i] +=
+                            b.n[i].load(std::memory_order_relaxed);
+                    }
+                    sums[h] += b.sum.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        char line[128];
+        for (uint8_t i = 0; i < metrics::kNCounter; ++i) {
+            header(out, kArrCounter[i], "counter");
+            std::snprintf(line, sizeof(line), "%s %lu\n", kArrCounter[i].name,
+                          static_cast<unsigned long>(counters[i]));
+            out += line;
+        }
+        for (uint8_t i = 0; i < metrics::kNGauge; ++i) {
+            header(out, kArrGauge[i], "gauge");
+            std::snprintf(line, sizeof(line), "%s %ld\n", kArrGauge[i].name,
+                          static_cast<long>(gauges[i]));
+            out += line;
+        }
+        for (uint8_t h = 0; h < metrics::kNHistogram; ++h) {
+            const HistDesc &d = kArrHistogram[h];
+            header(out, d.d, "histogram");
+            // buckets are cumulative
+            uint64_t n = 0;
+            for (uint8_t i = 0; i < metrics::kNBucket; ++i) {
+                n += buckets[h][i];
+                if (i + 1 < metrics::kNBucket) {
+                    std::snprintf(line, sizeof(line),
+                                  "%s_bucket{le=\"%g\"} %lu\n", d.d.name,
+                                  static_cast<double>(d.base << i) / d.unit,
+                                  static_cast<unsigned long>(n));
+                } else {
+                    std::snprintf(line, sizeof(line),
+                                  "%s_bucket{le=\"+Inf\"} %lu\n", d.d.name,
+                                  static_cast<unsigned long>(n));
+                }
+                out += line;
+            }
+            std::snprintf(line, sizeof(line), "%s_sum %g\n%s_count %lu\n",
+                          d.d.name, static_cast<double>(sums[h]) / d.unit,
+                          d.d.name, static_cast<unsigned long>(n));
+            out += line;
+        }
+    }
+
+    static inline bool write_all(int fd, const char *p, size_t n) {
+        while (n > 0) {
+            const ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+            if (k < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            p += k;
+            n -= static_cast<size_t>(k);
+        }
+        return true;
+    }
+
+    // answer every connection with the metrics, whatever it asked for
+    static void loop(int lfd) {
+        std::string body;
+        std::string resp;
+        char req[4096];
+        while (true) {
+            const int fd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                std::perror("metrics");
+                return;
+            }
+            // a scraper that does not send its request in time is cut off
+            const timeval timeout{1, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                       sizeof(timeout));
+            if (read(fd, req, sizeof(req)) > 0) {
+                body.clear();
+                render(body);
+                resp = "HTTP/1.0 200 OK\r\n"
+                       "Content-Type: text/plain; version=0.0.4\r\n"
+                       "Connection: close\r\n"
+                       "Content-Length: " +
+                       std::to_string(body.size()) + "\r\n\r\n";
+                resp += body;
+                write_all(fd, resp.data(), resp.size());
+            }
+            close(fd);
+        }
+    }
+
+} // namespace
+
+metrics::Slot *metrics::attach() {
+    auto *s = new Slot();
+    std::lock_guard<std::mutex> lock(mu);
+    slots.push_back(s);
+    return s;
+}
+
+void metrics::observe(Histogram h, uint64_t v) {
+    const uint8_t i = static_cast<uint8_t>(h);
+    const uint64_t q = v == 0 ? 0 : (v - 1) / kArrHistogram[i].base;
+    const uint8_t b = static_cast<uint8_t>(
+        std::min<int>(std::bit_width(q), kNBucket - 1));
+    Slot::Buckets &hist = local().histograms[i];
+    bump(hist.n[b], 1);
+    bump(hist.sum, v);
+}
+
+bool metrics::serve(const char *where) {
+    char *end;
+    const unsigned long port = std::strtoul(where, &end, 10);
+    int lfd;
+    if (*where != '\0' && *end == '\0') {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        const int one = 1;
+        lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (lfd >= 0)
+            setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (lfd < 0 || port > UINT16_MAX ||
+            bind(lfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+            std::perror("metrics");
+            return false;
+        }
+    } else {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (std::strlen(where) >= sizeof(addr.sun_path)) {
+            std::fprintf(stderr, "socket path too long: %s\n", where);
+            return false;
+        }
+        std::strncpy(addr.sun_path, where, sizeof(addr.sun_path) - 1);
+        lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        unlink(where);
+        if (lfd < 0 ||
+            bind(lfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+            std::perror("metrics");
+            return false;
+        }
+    }
+    if (listen(lfd, SOMAXCONN) < 0) {
+        std::perror("metrics");
+        return false;
+    }
+    std::thread(loop, lfd).detach();
+    return true;
+}
@@ -0,0 +1,128 @@
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "core.hpp"
+#include "net.hpp"
+#include "term.hpp"
+
+namespace {
+
+    static inline int dial(const char *path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (std::strlen(path) >= sizeof(addr.sun_path)) {
+            std::fprintf(stderr, "socket path too long: %s\n", path);
+            return -1;
+        }
+        std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&addr),
+                                sizeof(addr)) < 0) {
+            std::perror("connect");
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Thin client: forward keys to the server (players only) and render the
+    // frames it sends back; all game logic runs on the server.
+    static inline int run(int fd, bool forward) {
+        // Enable raw mode
+        term::Termios orig_termios;
+        term::enableRawMode(orig_termios);
+
+        std::array<std::string, HEIGHT> screen;
+        field_t field{};
+        net::Frame f{0, ' ', 0};
+        std::string buf;
+        std::string frame;
+        term::Output out;
+        char tmp[4096];
+        pollfd fds[3] = {{STDIN_FILENO, POLLIN, 0},
+                         {fd, POLLIN, 0},
+                         {out.fd, POLLOUT, 0}};
+
+        bool quit = false;
+        bool keyed = false; // a keyframe was received
+        bool stray = false; // a spectator got a delta before its keyframe
+        while (!quit && !stray) {
+            // only wait for the terminal while output is pending
+            if (poll(fds, out.Pending() ? 3 : 2, -1) < 0)
+                continue;
+            out.Flush();
+
+            if (fds[0].revents & POLLIN) {
+                ssize_t n = read(STDIN_FILENO, tmp, sizeof(tmp));
+                if (n > 0) {
+                    if (forward)
+                        send(fd, tmp, static_cast<size_t>(n), MSG_NOSIGNAL);
+                    quit = std::memchr(tmp, 'q', static_cast<size_t>(n));
+                }
+            }
+
+            if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+                if (n <= 0)
+                    break;
+                buf.append(tmp, static_cast<size_t>(n));
+
+                // apply every complete frame, render only the latest
+                size_t pos = 0, len;
+                while ((len = net::decode(std::string_view(buf).substr(pos),
+                                          f, field)) > 0) {
+                    pos += len;
+                    // a spectator is only sent the frames of the session it
+                    // watches, from a keyframe on; a delta first is a frame
+                    // of some other game
+                    keyed = keyed || (f.flags & net::kFlagKey);
+                    if (!forward && !keyed) {
+                        stray = true;
+                        break;
+                    }
+                }
+                buf.erase(0, pos);
+                if (pos > 0) {
+                    core::ToString(field, screen);
+                    term::clearScreen(frame);
+                    term::printScreen(screen, f.next, f.lines,
+                                      f.flags & net::kFlagOver, frame);
+                    out.Present(frame);
+                }
+            }
+        }
+
+        out.Drain();
+        term::disableRawMode(orig_termios);
+        close(fd);
+        if (stray) {
+            std::fprintf(stderr, "watch: first frame is not a keyframe\n");
+            return 1;
+        }
+        return 0;
+    }
+
+} // namespace
+
+int net::play(const char *path) {
+    int fd = dial(path);
+    if (fd < 0)
+        return 1;
+    send(fd, &kHelloPlay, 1, MSG_NOSIGNAL);
+    return run(fd, true);
+}
+
+int net::watch(const char *path, uint32_t id) {
+    int fd = dial(path);
+    if (fd < 0)
+        return 1;
+    char hello[kHelloSize];
+    encode_hello(id, hello);
+    send(fd, hello, sizeof(hello), MSG_NOSIGNAL);
+    return run(fd, false);
+}
@@ -0,0 +1,944 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <coroutine>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <csignal>
+#include <mutex>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "core.hpp"
+#include "evlog.hpp"
+#include "metrics.hpp"
+#include "net.hpp"
+#include "timing.hpp"
+
+// The server runs one shard per core: a thread with its own epoll instance,
+// timer wheel and sessions. All shards wait on the listening socket with
+// EPOLLEXCLUSIVE, so each connection wakes up a single one of them, which
+// then hosts the game for its whole life.
+//
+// Each game is a coroutine (`run`) suspended on "next key or next deadline":
+// its socket is registered with the shard's epoll and its next
+// `timing::Engine` deadline with the shard's timer wheel, and whichever comes
+// first resumes it. There is no global tick; an idle game costs its
+// `Session` and a coroutine frame, not a thread and its stack.
+namespace {
+    // epoll tags; sessions are tagged by slot, and spectators by slot with
+    // `kTagWatch` set
+    inline constexpr uint32_t kTagListen = UINT32_MAX;
+    inline constexpr uint32_t kTagTimer = UINT32_MAX - 1;
+    inline constexpr uint32_t kTagInbox = UINT32_MAX - 2;
+    inline constexpr uint32_t kTagSignal = UINT32_MAX - 3;
+    inline constexpr uint32_t kTagWatch = 1u << 31;
+    // session ids are `shard << kShardShift | slot`
+    inline constexpr uint32_t kShardShift = 20;
+    inline constexpr uint32_t kSlotMask = (1u << kShardShift) - 1;
+    // end of an index-linked list
+    inline constexpr uint32_t kNil = UINT32_MAX;
+    inline constexpr int kMaxEvents = 256;
+    // connections accepted per wake-up, the other shards take the rest
+    inline constexpr int kMaxAccept = 16;
+    // drop a player once this many bytes are waiting to be written
+    inline constexpr size_t kMaxPending = 1 << 16;
+    // time between two stats reports
+    inline constexpr steady_clock::duration kStatsPeriod =
+        std::chrono::seconds(10);
+    // frames kept for spectators (power of 2), ~0.6 s of continuous play
+    inline constexpr uint64_t kRingSlots = 64;
+    // frames handed to the kernel per `sendmsg`
+    inline constexpr size_t kMaxIov = 32;
+    // timer wheel slots (power of 2) and their width, ~1 s per turn
+    inline constexpr uint64_t kWheelSlots = 4096;
+    inline constexpr steady_clock::duration kWheelTick =
+        std::chrono::microseconds(250);
+
+    // size of a session coroutine frame, for the stats
+    static std::atomic<size_t> frame_bytes{0};
+
+    // Coroutine of one session, see `run`
+    //
+    // It starts suspended, and is only resumed and destroyed by its shard.
+    struct Task {
+        struct promise_type {
+            Task get_return_object() {
+                return Task{
+                    std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+
+            static void *operator new(size_t n) {
+                frame_bytes.store(n, std::memory_order_relaxed);
+                return ::operator new(n);
+            }
+            static void operator delete(void *ptr) { ::operator delete(ptr); }
+        };
+
+        std::coroutine_handle<promise_type> h;
+    };
+
+    // Frames of one broadcast game, encoded once and shared by all of its
+    // spectators
+    //
+    // Frame `seq` lives in slot `seq % kRingSlots` until it is overwritten by
+    // frame `seq + kRingSlots`; instead of reference counting each slot, every
+    // spectator holds the sequence number of the next frame it has to send,
+    // so publishing a frame is O(1) regardless of the audience.
+    struct Ring {
+        struct Slot {
+            uint8_t len;
+            char data[net::kMaxFrame];
+        };
+        std::array<Slot, kRingSlots> slots;
+        uint64_t head = 0; // sequence number of the next frame
+
+        Slot &at(uint64_t seq) { return slots[seq & (kRingSlots - 1)]; }
+    };
+
+    // One game hosted by the server
+    //
+    // Sessions live in a deque, so that their coroutines can hold on to
+    // them, and are addressed by slot; a slot is recycled once its client
+    // disconnects, so memory is bounded by the peak number of concurrent
+    // clients. The ring is only allocated once the first spectator shows up.
+    struct Session {
+        core::Board b;
+        core::Piece p;
+        timing::Engine eng;             // gravity, lock delay and auto-shift
+        time_point paused_at;           // when the client paused
+        net::Frame sent;                // header of the last frame sent
+        int fd;                         // client socket, -1 once closed
+        bool over;                      // game over, stop stepping
+        bool paused;                    // paused by the client
+        bool want_out;                  // registered for EPOLLOUT
+        uint8_t hello_n;                // bytes of `hello` read so far
+        // watch hello of a new connection, while it arrives
+        std::array<char, net::kHelloSize> hello;
+        std::coroutine_handle<> co;     // suspended game loop, null if none
+        std::string out;                // encoded frames not yet written
+        std::unique_ptr<Ring> ring;     // broadcast frames, if watched
+        std::vector<uint32_t> watchers; // spectator slots
+    };
+
+    // One spectator
+    //
+    // It sends straight from the ring of the session it watches; `tail` only
+    // holds bytes that are not in the ring: a keyframe when the spectator
+    // fell too far behind, or the rest of a frame the socket accepted half
+    // of.
+    struct Watcher {
+        int fd;        // client socket, -1 if the slot is free
+        uint32_t id;   // watched session slot
+        uint64_t seq;  // next frame to send
+        bool want_out; // registered for EPOLLOUT
+        std::string tail;
+    };
+
+    // Hashed timer wheel
+    //
+    // Each session has at most one timer, linked into the slot its deadline
+    // falls in; timers more than one turn away share the slot with nearer
+    // ones and are skipped until their turn comes. A bitmap of non-empty
+    // slots finds the next wake-up without walking the empty ones.
+    struct Wheel {
+        struct Node {
+            time_point due;
+            uint32_t slot = kNil; // wheel slot, `kNil` if not armed
+            uint32_t prev = kNil;
+            uint32_t next = kNil;
+        };
+        std::vector<Node> nodes; // by session slot
+        std::array<uint32_t, kWheelSlots> heads;
+        std::array<uint64_t, kWheelSlots / 64> used{};
+        uint64_t cur; // tick up to which timers have expired
+
+        static uint64_t tick(const time_point &t) {
+            return static_cast<uint64_t>(t.time_since_epoch() / kWheelTick);
+        }
+
+        Wheel() : cur(tick(steady_clock::now())) { heads.fill(kNil); }
+
+        void Add(uint32_t id, const time_point &due) {
+            Node &n = nodes[id];
+            // overdue timers go to the current slot, they expire right away
+            const uint32_t s =
+                static_cast<uint32_t>(std::max(tick(due), cur) &
+                                      (kWheelSlots - 1));
+            n.due = due;
+            n.slot = s;
+            n.prev = kNil;
+            n.next = heads[s];
+            if (n.next != kNil)
+                nodes[n.next].prev = id;
+            heads[s] = id;
+            used[s / 64] |= 1ull << (s % 64);
+        }
+
+        void Cancel(uint32_t id) {
+            Node &n = nodes[id];
+            if (n.slot == kNil)
+                return;
+            if (n.prev != kNil) {
+                nodes[n.prev].next = n.next;
+            } else {
+                heads[n.slot] = n.next;
+                if (n.next == kNil)
+                    used[n.slot / 64] &= ~(1ull << (n.slot % 64));
+            }
+            if (n.next != kNil)
+                nodes[n.next].prev = n.prev;
+            n.slot = kNil;
+        }
+
+        // move the timers due at `now` to `out`, recording their lateness
+        void Expire(const time_point &now, std::vector<uint32_t> &out,
+                    timing::Jitter &late) {
+            const uint64_t until = tick(now);
+            // one turn visits every slot
+            const uint64_t from =
+                until - cur >= kWheelSlots ? until - kWheelSlots + 1 : cur;
+            for (uint64_t t = from; t <= until; ++t) {
+                const uint64_t s = t & (kWheelSlots - 1);
+                for (uint32_t id = heads[s]; id != kNil;) {
+                    const uint32_t next = nodes[id].next;
+                    if (nodes[id].due <= now) {
+                        late.Add(now - nodes[id].due);
+                        Cancel(id);
+                        out.push_back(id);
+                    }
+                    id = next;
+                }
+            }
+            cur = until;
+        }
+
+        // earliest time worth waking up for, `time_point::max()` if none
+        time_point Next() const {
+            // timers of the current turn in the current slot: exact deadline
+            const uint64_t c = cur & (kWheelSlots - 1);
+            time_point best = time_point::max();
+            for (uint32_t id = heads[c]; id != kNil; id = nodes[id].next) {
+                if (tick(nodes[id].due) <= cur)
+                    best = std::min(best, nodes[id].due);
+            }
+            if (best != time_point::max())
+                return best;
+            // otherwise the start of the next non-empty slot
+            for (uint64_t d = 1; d <= kWheelSlots;) {
+                const uint64_t s = (c + d) & (kWheelSlots - 1);
+                const uint64_t bits = used[s / 64] >> (s % 64);
+                if (bits == 0) {
+                    d += 64 - s % 64;
+                    continue;
+                }
+                d += std::countr_zero(bits);
+                if (d <= kWheelSlots)
+                    return time_point(kWheelTick * (cur + d));
+            }
+            return time_point::max();
+        }
+    };
+
+    // counters accumulated over one stats window
+    struct Stats {
+        uint64_t wakeups = 0;   // game loop resumptions
+        uint32_t keyframes = 0; // sent to spectators that fell behind
+        timing::Jitter late;    // lateness of timer wake-ups
+        timing::Jitter jitter;  // lateness of game deadlines
+    };
+
+    struct Shard;
+    typedef std::vector<std::unique_ptr<Shard>> shards_t;
+
+    // One scheduler thread
+    struct Shard {
+        uint32_t id;
+        int ep;  // epoll instance
+        int tfd; // timerfd, armed for the next wheel wake-up
+        int efd; // eventfd, signals the inbox
+        time_point armed = time_point::max();
+        const shards_t *all;
+        std::deque<Session> sessions;
+        std::vector<uint32_t> free_sessions;
+        std::vector<Watcher> watchers;
+        std::vector<uint32_t> free_watchers;
+        Wheel wheel;
+        std::vector<uint32_t> ready; // sessions whose timer expired
+        // spectator sockets handed over by other shards, with the slot of
+        // the session they watch
+        std::mutex mu;
+        std::vector<std::pair<int, uint32_t>> inbox;
+        Stats st;
+        time_point next_report;
+    };
+
+    static inline void ctl(int ep, int op, int fd, uint32_t events,
+                           uint32_t tag) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u32 = tag;
+        epoll_ctl(ep, op, fd, &ev);
+    }
+
+    // only ask for EPOLLOUT while output is pending
+    static inline void want_out(int ep, int fd, bool &cur, bool want,
+                                uint32_t tag) {
+        if (want != cur) {
+            cur = want;
+            ctl(ep, EPOLL_CTL_MOD, fd, want ? EPOLLIN | EPOLLOUT : EPOLLIN,
+                tag);
+        }
+    }
+
+    // arm the timerfd for `t`, or disarm it for `time_point::max()`
+    static inline void arm(Shard &sh, const time_point &t) {
+        if (t == sh.armed)
+            return;
+        sh.armed = t;
+        itimerspec its{};
+        if (t != time_point::max()) {
+            // steady_clock is CLOCK_MONOTONIC; 0 would disarm the timer
+            const auto ns = std::max<int64_t>(
+                timing::nsec(t.time_since_epoch()).count(), 1);
+            its.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+            its.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+        }
+        timerfd_settime(sh.tfd, TFD_TIMER_ABSTIME, &its, nullptr);
+    }
+
+    // `detach` removes the spectator from the list of its session
+    static inline void close_watcher(Shard &sh, uint32_t slot, bool detach) {
+        Watcher &w = sh.watchers[slot];
+        epoll_ctl(sh.ep, EPOLL_CTL_DEL, w.fd, nullptr);
+        close(w.fd);
+        w.fd = -1;
+        w.tail.clear();
+        w.tail.shrink_to_fit();
+        sh.free_watchers.push_back(slot);
+        if (detach) {
+            auto &list = sh.sessions[w.id].watchers;
+            list.erase(std::find(list.begin(), list.end(), slot));
+        }
+    }
+
+    // release a session whose game loop returned, along with its spectators
+    static inline void close_session(Shard &sh, uint32_t slot) {
+        Session &s = sh.sessions[slot];
+        if (s.fd >= 0) {
+            epoll_ctl(sh.ep, EPOLL_CTL_DEL, s.fd, nullptr);
+            close(s.fd);
+            s.fd = -1;
+        }
+        for (uint32_t w : s.watchers) {
+            close_watcher(sh, w, false);
+        }
+        s.watchers.clear();
+        s.out.clear();
+        s.out.shrink_to_fit();
+        s.ring.reset();
+        evlog::detach(s.eng.log);
+        s.eng.log = nullptr;
+        metrics::add(metrics::Gauge::Sessions, -1);
+        sh.free_sessions.push_back(slot);
+    }
+
+    // write as much pending output as the socket takes; return false if the
+    // client is gone or too slow to keep up
+    static inline bool flush(Shard &sh, uint32_t slot) {
+        Session &s = sh.sessions[slot];
+        while (!s.out.empty()) {
+            ssize_t n = send(s.fd, s.out.data(), s.out.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    return false;
+                break;
+            }
+            s.out.erase(0, static_cast<size_t>(n));
+        }
+        if (s.out.size() > kMaxPending)
+            return false;
+        want_out(sh.ep, s.fd, s.want_out, !s.out.empty(), slot);
+        return true;
+    }
+
+    static inline net::Frame header(Session &s) {
+        return net::Frame{s.b.lines, s.p.Shape(s.b.next),
+                          static_cast<uint8_t>(s.over ? net::kFlagOver : 0)};
+    }
+
+    // send the spectator everything it is missing, straight from the ring;
+    // return false if it is gone
+    static inline bool flush_watcher(Shard &sh, uint32_t slot) {
+        Watcher &w = sh.watchers[slot];
+        Session &s = sh.sessions[w.id];
+        Ring &r = *s.ring;
+
+        // frames it still needs were overwritten, catch up with a keyframe
+        // (after the rest of a half-sent frame, if any)
+        if (r.head - w.seq > kRingSlots) {
+            char key[net::kMaxFrame];
+            w.tail.append(key, net::encode_key(header(s), s.b.active, key));
+            w.seq = r.head;
+            ++sh.st.keyframes;
+        }
+
+        while (!w.tail.empty() || w.seq != r.head) {
+            iovec iov[kMaxIov];
+            size_t n_iov = 0;
+            if (!w.tail.empty()) {
+                iov[n_iov++] = {w.tail.data(), w.tail.size()};
+            }
+            for (uint64_t q = w.seq; q != r.head && n_iov < kMaxIov; ++q) {
+                iov[n_iov++] = {r.at(q).data, r.at(q).len};
+            }
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = n_iov;
+            ssize_t n = sendmsg(w.fd, &msg, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    return false;
+                break;
+            }
+
+            // consume what was sent
+            size_t left = static_cast<size_t>(n);
+            if (!w.tail.empty()) {
+                const size_t k = std::min(left, w.tail.size());
+                w.tail.erase(0, k);
+                left -= k;
+            }
+            while (left > 0) {
+                const Ring::Slot &f = r.at(w.seq++);
+                if (left < f.len) {
+                    // the ring will move on, keep the rest of this frame
+                    w.tail.assign(f.data + left, f.len - left);
+                    break;
+                }
+                left -= f.len;
+            }
+        }
+        want_out(sh.ep, w.fd, w.want_out, !w.tail.empty() || w.seq != r.head,
+                 slot | kTagWatch);
+        return true;
+    }
+
+    // make `fd` a spectator of session `id` of this shard
+    static inline void attach(Shard &sh, int fd, uint32_t id) {
+        // only a suspended game can be watched
+        if (id >= sh.sessions.size() || !sh.sessions[id].co) {
+            close(fd);
+            return;
+        }
+        Session &t = sh.sessions[id];
+        if (!t.ring) {
+            t.ring = std::make_unique<Ring>();
+        }
+
+        uint32_t w_slot;
+        if (!sh.free_watchers.empty()) {
+            w_slot = sh.free_watchers.back();
+            sh.free_watchers.pop_back();
+        } else {
+            w_slot = static_cast<uint32_t>(sh.watchers.size());
+            sh.watchers.emplace_back();
+        }
+        Watcher &w = sh.watchers[w_slot];
+        w.fd = fd;
+        w.id = id;
+        // start one frame past the ring so that the first flush sends a
+        // keyframe of the current state
+        w.seq = t.ring->head - kRingSlots - 1;
+        w.want_out = false;
+        t.watchers.push_back(w_slot);
+        ctl(sh.ep, EPOLL_CTL_ADD, fd, EPOLLIN, w_slot | kTagWatch);
+        if (!flush_watcher(sh, w_slot))
+            close_watcher(sh, w_slot, true);
+    }
+
+    // turn the connection of session `slot` into a spectator of session
+    // `id`, on whichever shard hosts it
+    static inline void handover(Shard &sh, uint32_t slot, uint32_t id) {
+        Session &s = sh.sessions[slot];
+        const int fd = s.fd;
+        epoll_ctl(sh.ep, EPOLL_CTL_DEL, fd, nullptr);
+        s.fd = -1;
+
+        const uint32_t target = id >> kShardShift;
+        if (target >= sh.all->size()) {
+            close(fd);
+        } else if (target == sh.id) {
+            attach(sh, fd, id & kSlotMask);
+        } else {
+            Shard &t = *(*sh.all)[target];
+            {
+                std::lock_guard<std::mutex> lock(t.mu);
+                t.inbox.emplace_back(fd, id & kSlotMask);
+            }
+            const uint64_t one = 1;
+            write(t.efd, &one, sizeof(one));
+        }
+    }
+
+    enum class Read : uint8_t {
+        Ok,    // keys applied, if any
+        Close, // client quit or is gone
+    };
+
+    // consume the keys sent by a client
+    static inline Read read_keys(Shard &sh, uint32_t slot,
+                                 const time_point &now) {
+        Session &s = sh.sessions[slot];
+        char keys[64];
+        while (true) {
+            ssize_t n = read(s.fd, keys, sizeof(keys));
+            if (n == 0)
+                return Read::Close;
+            if (n < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK ||
+                               errno == EINTR
+                           ? Read::Ok
+                           : Read::Close;
+            metrics::observe(metrics::Histogram::InputDepth,
+                             static_cast<uint64_t>(n));
+            for (ssize_t i = 0; i < n; ++i) {
+                if (keys[i] == 'q') {
+                    return Read::Close;
+                } else if (keys[i] == 'p') {
+                    // the game does not go on while paused
+                    if (s.paused)
+                        s.eng.Delay(now - s.paused_at, s.b);
+                    s.paused = !s.paused;
+                    s.paused_at = now;
+                } else if (!s.over && !s.paused) {
+                    s.eng.Key(keys[i], now, s.p, s.b);
+                }
+            }
+        }
+    }
+
+    // count a frame of `len` bytes whose building started at `t0`
+    static inline void count_frame(const time_point &t0, uint8_t len) {
+        metrics::add(metrics::Counter::Frames);
+        metrics::add(metrics::Counter::Bytes, len);
+        metrics::observe(metrics::Histogram::FrameTime,
+                         static_cast<uint64_t>(
+                             timing::nsec(steady_clock::now() - t0).count()));
+    }
+
+    // queue the frame from `prev` to the current board for the player and
+    // the spectators
+    static inline void publish(Shard &sh, uint32_t slot, const field_t &prev) {
+        Session &s = sh.sessions[slot];
+        const time_point t0 = steady_clock::now();
+        s.b.UpdateActive(s.p.cur);
+        const net::Frame f = header(s);
+        if (f == s.sent && prev == s.b.active)
+            return;
+        s.sent = f;
+        uint8_t len;
+        if (!s.ring) {
+            char buf[net::kMaxFrame];
+            len = net::encode(f, prev, s.b.active, buf);
+            s.out.append(buf, len);
+            count_frame(t0, len);
+            return;
+        }
+
+        // encode once into the ring, the player gets a copy
+        Ring::Slot &frame = s.ring->at(s.ring->head++);
+        len = frame.len = net::encode(f, prev, s.b.active, frame.data);
+        s.out.append(frame.data, frame.len);
+        count_frame(t0, len);
+        // spectators blocked on a slow socket wait for EPOLLOUT instead
+        for (size_t i = s.watchers.size(); i-- > 0;) {
+            const uint32_t w = s.watchers[i];
+            if (!sh.watchers[w].want_out && !flush_watcher(sh, w))
+                close_watcher(sh, w, true);
+        }
+    }
+
+    // suspend a game loop until its socket has news or `until` is due
+    struct Sleep {
+        Shard &sh;
+        uint32_t slot;
+        time_point until;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            sh.sessions[slot].co = h;
+            if (until != time_point::max())
+                sh.wheel.Add(slot, until);
+        }
+        void await_resume() const noexcept {}
+    };
+
+    // game loop of one session, returns once the client is gone
+    static Task run(Shard &sh, uint32_t slot) {
+        Session &s = sh.sessions[slot];
+        while (true) {
+            const time_point now = steady_clock::now();
+            // landing rewrites `active`, keep the previous frame for the diff
+            const field_t prev = s.b.active;
+            if (read_keys(sh, slot, now) != Read::Ok)
+                break;
+            if (!s.over && !s.paused)
+                s.over = s.eng.Run(now, s.p, s.b);
+            publish(sh, slot, prev);
+            if (!flush(sh, slot))
+                break;
+            co_await Sleep{sh, slot,
+                           s.over || s.paused ? time_point::max()
+                                              : s.eng.Next()};
+        }
+    }
+
+    // resume the game loop of a session, and release the session once the
+    // loop returned
+    static inline void wake(Shard &sh, uint32_t slot) {
+        Session &s = sh.sessions[slot];
+        if (!s.co)
+            return;
+        sh.wheel.Cancel(slot);
+        const std::coroutine_handle<> h = std::exchange(s.co, nullptr);
+        ++sh.st.wakeups;
+        h.resume();
+        if (h.done()) {
+            h.destroy();
+            close_session(sh, slot);
+        }
+    }
+
+    // start the game of the player connected on session `slot`
+    static inline void start(Shard &sh, uint32_t slot) {
+        Session &s = sh.sessions[slot];
+        s.b = core::Board();
+        s.p.Spawn(s.b.Pop());
+        s.eng.log = evlog::attach(sh.id << kShardShift | slot);
+        s.eng.Start(s.p, s.b);
+        metrics::add(metrics::Gauge::Sessions, 1);
+        // force the first frame out, it is a keyframe
+        s.sent = net::Frame{0, '\0', UINT8_MAX};
+        s.over = false;
+        s.paused = false;
+        s.co = run(sh, slot).h;
+        std::fprintf(stderr, "session %u: connected\n",
+                     sh.id << kShardShift | slot);
+        wake(sh, slot);
+    }
+
+    // release session `slot` of a connection that never started a game
+    static inline void drop(Shard &sh, uint32_t slot) {
+        Session &s = sh.sessions[slot];
+        if (s.fd >= 0) {
+            epoll_ctl(sh.ep, EPOLL_CTL_DEL, s.fd, nullptr);
+            close(s.fd);
+            s.fd = -1;
+        }
+        sh.free_sessions.push_back(slot);
+    }
+
+    static inline bool again(ssize_t n) {
+        return n < 0 &&
+               (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+    }
+
+    // Tell what a new connection is from its first bytes, before anything
+    // is set up for it: a spectator's watch hello (which may arrive over
+    // several reads) hands it over, anything else starts a game. Keys of a
+    // player that sent no `kHelloPlay` are left for `read_keys`.
+    static inline void greet(Shard &sh, uint32_t slot) {
+        Session &s = sh.sessions[slot];
+        if (s.hello_n == 0) {
+            char first;
+            const ssize_t n = recv(s.fd, &first, 1, MSG_PEEK);
+            if (again(n))
+                return;
+            if (n <= 0) {
+                drop(sh, slot);
+                return;
+            }
+            if (first == net::kHelloPlay)
+                recv(s.fd, &first, 1, 0);
+            if (first != net::kHelloWatch) {
+                start(sh, slot);
+                return;
+            }
+        }
+        const ssize_t n = read(s.fd, s.hello.data() + s.hello_n,
+                               net::kHelloSize - s.hello_n);
+        if (again(n))
+            return;
+        if (n <= 0) {
+            drop(sh, slot);
+            return;
+        }
+        s.hello_n += static_cast<uint8_t>(n);
+        if (s.hello_n < net::kHelloSize)
+            return;
+        handover(sh, slot, net::decode_hello(s.hello.data()));
+        sh.free_sessions.push_back(slot);
+    }
+
+    static inline void accept_some(Shard &sh, int lfd) {
+        for (int i = 0; i < kMaxAccept; ++i) {
+            int fd = accept4(lfd, nullptr, nullptr,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return;
+            uint32_t slot;
+            if (!sh.free_sessions.empty()) {
+                slot = sh.free_sessions.back();
+                sh.free_sessions.pop_back();
+            } else if (sh.sessions.size() <= kSlotMask) {
+                slot = static_cast<uint32_t>(sh.sessions.size());
+                sh.sessions.emplace_back();
+                sh.wheel.nodes.emplace_back();
+            } else {
+                close(fd);
+                continue;
+            }
+            // nothing is set up until its first bytes tell what it is
+            Session &s = sh.sessions[slot];
+            s.fd = fd;
+            s.want_out = false;
+            s.hello_n = 0;
+            ctl(sh.ep, EPOLL_CTL_ADD, fd, EPOLLIN, slot);
+            greet(sh, slot);
+        }
+    }
+
+    static inline void report(Shard &sh) {
+        Stats &st = sh.st;
+        const size_t live = sh.sessions.size() - sh.free_sessions.size();
+        const size_t spectators =
+            sh.watchers.size() - sh.free_watchers.size();
+        size_t pending = 0;
+        for (auto &s : sh.sessions) {
+            pending += s.out.capacity() + (s.ring ? sizeof(Ring) : 0);
+            st.jitter.n += s.eng.jitter.n;
+            st.jitter.sum += s.eng.jitter.sum;
+            st.jitter.max = std::max(st.jitter.max, s.eng.jitter.max);
+            s.eng.jitter = timing::Jitter{};
+        }
+        std::fprintf(stderr,
+                     "shard %u: sessions=%zu spectators=%zu slots=%zu "
+                     "session_bytes=%zu frame_bytes=%zu out_bytes=%zu "
+                     "wakeups=%lu keyframes=%u\n",
+                     sh.id, live, spectators, sh.sessions.size(),
+                     sizeof(Session) + sizeof(Wheel::Node),
+                     frame_bytes.load(std::memory_order_relaxed), pending,
+                     static_cast<unsigned long>(st.wakeups), st.keyframes);
+        char name[32];
+        std::snprintf(name, sizeof(name), "shard %u: timers", sh.id);
+        st.late.Report(name);
+        std::snprintf(name, sizeof(name), "shard %u: timing", sh.id);
+        st.jitter.Report(name);
+        st = Stats{};
+    }
+
+    // set once SIGINT or SIGTERM arrived; every shard then ends its sessions
+    // and returns
+    static std::atomic<bool> stopping{false};
+
+    // eventfd signalled by `on_signal`, watched by shard 0
+    static int signal_fd = -1;
+
+    // any thread may take the signal, the event loop of shard 0 handles it
+    static void on_signal(int) {
+        const int saved = errno;
+        const uint64_t one = 1;
+        write(signal_fd, &one, sizeof(one));
+        errno = saved;
+    }
+
+    // end every game of the shard and drop the spectators handed over to it
+    static inline void stop(Shard &sh) {
+        for (uint32_t slot = 0; slot < sh.sessions.size(); ++slot) {
+            Session &s = sh.sessions[slot];
+            if (!s.co) {
+                // connections that did not say what they are yet
+                if (s.fd >= 0)
+                    drop(sh, slot);
+                continue;
+            }
+            sh.wheel.Cancel(slot);
+            std::exchange(s.co, nullptr).destroy();
+            close_session(sh, slot);
+        }
+        std::lock_guard<std::mutex> lock(sh.mu);
+        for (const auto &[fd, id] : sh.inbox) {
+            close(fd);
+        }
+        sh.inbox.clear();
+    }
+
+    // event loop of one shard, returns once the server is stopping
+    static void loop(Shard &sh, int lfd) {
+        epoll_event events[kMaxEvents];
+        sh.next_report = steady_clock::now() + kStatsPeriod;
+        while (true) {
+            arm(sh, std::min(sh.wheel.Next(), sh.next_report));
+            int n = epoll_wait(sh.ep, events, kMaxEvents, -1);
+            for (int i = 0; i < n; ++i) {
+                const uint32_t tag = events[i].data.u32;
+                const uint32_t ev = events[i].events;
+                if (tag == kTagListen) {
+                    accept_some(sh, lfd);
+                } else if (tag == kTagTimer) {
+                    uint64_t expirations;
+                    read(sh.tfd, &expirations, sizeof(expirations));
+                } else if (tag == kTagSignal) {
+                    // only shard 0 watches the signals, it wakes the others
+                    // through their inbox
+                    uint64_t count;
+                    read(signal_fd, &count, sizeof(count));
+                    stopping.store(true, std::memory_order_relaxed);
+                    const uint64_t one = 1;
+                    for (const auto &other : *sh.all) {
+                        write(other->efd, &one, sizeof(one));
+                    }
+                } else if (tag == kTagInbox) {
+                    uint64_t count;
+                    read(sh.efd, &count, sizeof(count));
+                    std::vector<std::pair<int, uint32_t>> inbox;
+                    {
+                        std::lock_guard<std::mutex> lock(sh.mu);
+                        inbox.swap(sh.inbox);
+                    }
+                    for (const auto &[fd, id] : inbox) {
+                        attach(sh, fd, id);
+                    }
+                } else if (tag & kTagWatch) {
+                    // spectators only send their hello; anything else or a
+                    // hangup ends them
+                    const uint32_t slot = tag & ~kTagWatch;
+                    if (sh.watchers[slot].fd < 0)
+                        continue;
+                    if ((ev & (EPOLLERR | EPOLLHUP | EPOLLIN)) ||
+                        !flush_watcher(sh, slot))
+                        close_watcher(sh, slot, true);
+                } else if (!sh.sessions[tag].co) {
+                    // first bytes of a new connection
+                    if (sh.sessions[tag].fd >= 0)
+                        greet(sh, tag);
+                } else {
+                    // keys, hangup or room to write: the game loop sorts it
+                    // out
+                    wake(sh, tag);
+                }
+            }
+
+            const time_point now = steady_clock::now();
+            sh.wheel.Expire(now, sh.ready, sh.st.late);
+            for (uint32_t slot : sh.ready) {
+                wake(sh, slot);
+            }
+            sh.ready.clear();
+
+            if (now >= sh.next_report) {
+                report(sh);
+                sh.next_report = now + kStatsPeriod;
+            }
+
+            if (stopping.load(std::memory_order_relaxed)) {
+                stop(sh);
+                return;
+            }
+        }
+    }
+
+} // namespace
+
+int net::serve(const char *path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(addr.sun_path)) {
+        std::fprintf(stderr, "socket path too long: %s\n", path);
+        return 1;
+    }
+    std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    // SIGINT and SIGTERM only signal an eventfd; other threads (event log
+    // writer, metrics) may already run and take them too
+    signal_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct sigaction sa{};
+    sa.sa_handler = on_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (signal_fd < 0 || sigaction(SIGINT, &sa, nullptr) < 0 ||
+        sigaction(SIGTERM, &sa, nullptr) < 0) {
+        std::perror("signal");
+        return 1;
+    }
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (lfd < 0 ||
+        bind(lfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        listen(lfd, SOMAXCONN) < 0) {
+        std::perror("listen");
+        return 1;
+    }
+
+    // one shard per core, at most as many as session ids can address
+    const uint32_t n_shards =
+        std::clamp(std::thread::hardware_concurrency(), 1u,
+                   1u << (31 - kShardShift));
+    shards_t shards;
+    for (uint32_t i = 0; i < n_shards; ++i) {
+        auto sh = std::make_unique<Shard>();
+        sh->id = i;
+        sh->ep = epoll_create1(EPOLL_CLOEXEC);
+        sh->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        sh->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        sh->all = &shards;
+        ctl(sh->ep, EPOLL_CTL_ADD, lfd, EPOLLIN | EPOLLEXCLUSIVE, kTagListen);
+        ctl(sh->ep, EPOLL_CTL_ADD, sh->tfd, EPOLLIN, kTagTimer);
+        ctl(sh->ep, EPOLL_CTL_ADD, sh->efd, EPOLLIN, kTagInbox);
+        shards.push_back(std::move(sh));
+    }
+    ctl(shards[0]->ep, EPOLL_CTL_ADD, signal_fd, EPOLLIN, kTagSignal);
+    std::fprintf(stderr, "serving on %s with %u shards\n", path, n_shards);
+
+    // shard 0 runs on this thread; they all return once a signal came
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < n_shards; ++i) {
+        threads.emplace_back(loop, std::ref(*shards[i]), lfd);
+    }
+    loop(*shards[0], lfd);
+    for (auto &th : threads) {
+        th.join();
+    }
+
+    for (const auto &sh : shards) {
+        close(sh->ep);
+        close(sh->tfd);
+        close(sh->efd);
+    }
+    close(lfd);
+    unlink(path);
+    std::fprintf(stderr, "stopped serving on %s\n", path);
+    return 0;
+}
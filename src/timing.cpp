@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cstdio>
+#include <poll.h>
+#include <sys/prctl.h>
+
+#include "timing.hpp"
+
+namespace {
+
+    static inline uint8_t idx(const timing::Event &e) {
+        return static_cast<uint8_t>(e);
+    }
+
+    // keys subject to auto-shift
+    static inline bool repeats(const char &key) {
+        return key == 'h' || key == 'l' || key == 'j';
+    }
+
+    // keep the lock delay in sync with the piece after it moved (or tried to)
+    // at `t`
+    static inline void settle(timing::Engine &e, const time_point &t,
+                              const core::Piece &p, const core::Board &b,
+                              const bool moved) {
+        const bool grounded = core::collide(p.down, b.base);
+        if (!grounded) {
+            e.q.Disarm(timing::Event::Lock);
+        } else if (!e.q.Armed(timing::Event::Lock)) {
+            e.q.Arm(timing::Event::Lock, t + timing::kLockDelay);
+        } else if (moved && e.resets > 0) {
+            --e.resets;
+            e.q.Arm(timing::Event::Lock, t + timing::kLockDelay);
+        }
+    }
+
+    // log a key that moved or rotated the piece
+    static inline void moved(evlog::Stream *log, const char &key,
+                             const time_point &t, const core::Piece &p,
+                             const brick_t &before, const uint8_t &state) {
+        if (log == nullptr || (p.cur == before && p.state == state))
+            return;
+        log->Emit(key == 'k' ? evlog::Kind::Rotate : evlog::Kind::Move, t, p,
+                  static_cast<uint8_t>(key));
+    }
+
+} // namespace
+
+timing::Queue::Queue() { at.fill(time_point::max()); }
+
+void timing::Queue::Arm(const Event &e, const time_point &t) {
+    at[idx(e)] = t;
+}
+
+void timing::Queue::Disarm(const Event &e) { at[idx(e)] = time_point::max(); }
+
+bool timing::Queue::Armed(const Event &e) const {
+    return at[idx(e)] != time_point::max();
+}
+
+timing::Event timing::Queue::Next() const {
+    return static_cast<Event>(std::min_element(at.begin(), at.end()) -
+                              at.begin());
+}
+
+void timing::Jitter::Add(const nsec &late) {
+    ++n;
+    sum += late;
+    max = std::max(max, late);
+}
+
+// print the jitter summary to stderr
+void timing::Jitter::Report(const char *name) const {
+    using us = std::chrono::duration<double, std::micro>;
+    std::fprintf(stderr,
+                 "%s: deadlines=%lu jitter_avg=%.1fus jitter_max=%.1fus\n",
+                 name, static_cast<unsigned long>(n),
+                 us(sum).count() / (n ? n : 1), us(max).count());
+}
+
+void timing::Engine::Start(const core::Piece &p, const core::Board &b) {
+    q = Queue();
+    held = 0;
+    repeating = false;
+    resets = kLockResets;
+    q.Arm(Event::Gravity, b.last_fall + core::gravity(b.lines));
+    metrics::add(metrics::Counter::Started);
+    if (log != nullptr)
+        log->Emit(evlog::Kind::Spawn, steady_clock::now(), p);
+}
+
+void timing::Engine::Delay(const nsec &d, core::Board &b) {
+    for (auto &t : q.at) {
+        if (t != time_point::max())
+            t += d;
+    }
+    b.last_fall += d;
+    pressed += d;
+    last += d;
+}
+
+bool timing::Engine::Key(const char &key, const time_point &t,
+                         core::Piece &p, core::Board &b) {
+    // The same key again may be a tap or the first terminal repeat; it moves
+    // like a tap. Only another one close behind it is the terminal repeating
+    // (taps are never ~30 ms apart), which starts the auto-shift, no sooner
+    // than DAS after the press. From then on the engine repeats the key at
+    // its own pace and the terminal's repeats only push the release back.
+    if (key == held) {
+        if (!repeating && last != pressed && t - last < kRelease) {
+            repeating = true;
+            q.Arm(Event::Shift, std::max(t, pressed + kDAS));
+        }
+        if (repeating) {
+            q.Arm(Event::Release, t + kRelease);
+            return true;
+        }
+    }
+    const brick_t before = p.cur;
+    const uint8_t state = p.state;
+    if (!core::input(key, p, b))
+        return false;
+    moved(log, key, t, p, before, state);
+    if (repeats(key)) {
+        // a new press waits for the terminal's repeat delay, a possible
+        // repeat for the next repeat
+        const bool again = key == held;
+        if (!again)
+            pressed = t;
+        held = key;
+        last = t;
+        repeating = false;
+        q.Disarm(Event::Shift);
+        q.Arm(Event::Release, t + (again ? kRelease : kRepeatDelay));
+    }
+    settle(*this, t, p, b, p.cur != before);
+    return true;
+}
+
+bool timing::Engine::Run(const time_point &now, core::Piece &p,
+                         core::Board &b) {
+    while (true) {
+        const Event e = q.Next();
+        const time_point t = q.at[idx(e)];
+        if (t > now)
+            return false;
+        jitter.Add(now - t);
+        metrics::add(metrics::Counter::Ticks);
+        q.Disarm(e);
+
+        switch (e) {
+        case Event::Gravity:
+            b.last_fall = t;
+            if (!core::collide(p.down, b.base)) {
+                p.Down();
+            }
+            q.Arm(Event::Gravity, t + core::gravity(b.lines));
+            settle(*this, t, p, b, false);
+            break;
+        case Event::Lock:
+            // only lock if the piece is still on the ground
+            if (core::collide(p.down, b.base)) {
+                const core::Piece landed = p;
+                const uint16_t lines = b.lines;
+                const bool over = core::land(p, b);
+                metrics::add(metrics::Counter::Lines, b.lines - lines);
+                if (log != nullptr) {
+                    log->Emit(evlog::Kind::Land, t, landed);
+                    if (b.lines != lines)
+                        log->Emit(evlog::Kind::Clear, t, landed,
+                                  static_cast<uint8_t>(b.lines - lines));
+                    log->Emit(over ? evlog::Kind::Over : evlog::Kind::Spawn,
+                              t, p);
+                }
+                if (over) {
+                    metrics::add(metrics::Counter::Over);
+                    return true;
+                }
+                resets = kLockResets;
+                b.last_fall = t;
+                q.Arm(Event::Gravity, t + core::gravity(b.lines));
+            }
+            break;
+        case Event::Shift: {
+            const brick_t before = p.cur;
+            core::input(held, p, b);
+            moved(log, held, t, p, before, p.state);
+            q.Arm(Event::Shift, t + kARR);
+            settle(*this, t, p, b, p.cur != before);
+            break;
+        }
+        case Event::Release:
+            held = 0;
+            repeating = false;
+            q.Disarm(Event::Shift);
+            break;
+        }
+    }
+}
+
+time_point timing::Engine::Next() const { return q.at[idx(q.Next())]; }
+
+bool timing::wait(int fd, const time_point &until, int out) {
+    // the default 50us timer slack would dominate the wake-up error
+    static const int slack = prctl(PR_SET_TIMERSLACK, 1UL);
+    (void)slack;
+
+    const auto left = std::max(until - steady_clock::now(),
+                               steady_clock::duration::zero());
+    const auto s = std::chrono::duration_cast<std::chrono::seconds>(left);
+    timespec ts{static_cast<time_t>(s.count()),
+                static_cast<long>(nsec(left - s).count())};
+    pollfd pfd[2] = {{fd, POLLIN, 0}, {out, POLLOUT, 0}};
+    return ppoll(pfd, out < 0 ? 1 : 2,
+                 until == time_point::max() ? nullptr : &ts, nullptr) > 0 &&
+           (pfd[0].revents & POLLIN);
+}